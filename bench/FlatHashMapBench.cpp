@@ -0,0 +1,98 @@
+// Compares FlatHashMap with std::unordered_map on random uint64 keys.
+// Usage: flat_hash_map_bench [keyCount]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "FlatHashMap.h"
+#include "TuringTime.h"
+
+namespace {
+
+struct Result {
+    float insert {0.0f};
+    float findHit {0.0f};
+    float findMiss {0.0f};
+    float erase {0.0f};
+    uint64_t checksum {0};
+};
+
+// Nanoseconds per operation of func over count operations
+template <typename Func>
+float timePerOp(size_t count, Func&& func) {
+    const TimePoint start = Clock::now();
+    func();
+    return duration<Nanoseconds>(start, Clock::now()) / count;
+}
+
+template <typename Map>
+Result run(const std::vector<uint64_t>& keys, const std::vector<uint64_t>& missing) {
+    Result res;
+    Map map;
+
+    res.insert = timePerOp(keys.size(), [&] {
+        for (const uint64_t key : keys) {
+            map[key] = key;
+        }
+    });
+
+    // Lookups in another order than the insertions
+    std::vector<uint64_t> shuffled = keys;
+    std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937_64(1));
+
+    res.findHit = timePerOp(shuffled.size(), [&] {
+        for (const uint64_t key : shuffled) {
+            res.checksum += map.find(key)->second;
+        }
+    });
+
+    res.findMiss = timePerOp(missing.size(), [&] {
+        for (const uint64_t key : missing) {
+            res.checksum += map.count(key);
+        }
+    });
+
+    res.erase = timePerOp(shuffled.size(), [&] {
+        for (const uint64_t key : shuffled) {
+            res.checksum += map.erase(key);
+        }
+    });
+
+    return res;
+}
+
+void print(const char* name, const Result& res) {
+    printf("%-20s insert %7.1f ns  find hit %7.1f ns  find miss %7.1f ns  erase %7.1f ns\n",
+           name, res.insert, res.findHit, res.findMiss, res.erase);
+}
+
+}
+
+int main(int argc, char** argv) {
+    const size_t keyCount = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+
+    // Odd keys are inserted, even keys are looked up as misses
+    std::mt19937_64 rng(42);
+    std::vector<uint64_t> keys(keyCount);
+    std::vector<uint64_t> missing(keyCount);
+    for (size_t i = 0; i < keyCount; i++) {
+        keys[i] = rng() | 1;
+        missing[i] = rng() & ~1ull;
+    }
+
+    printf("%zu random uint64 keys\n", keyCount);
+
+    const Result flat = run<FlatHashMap<uint64_t, uint64_t>>(keys, missing);
+    const Result unordered = run<std::unordered_map<uint64_t, uint64_t>>(keys, missing);
+    print("FlatHashMap", flat);
+    print("std::unordered_map", unordered);
+
+    // Keeps the lookups from being optimized out
+    return flat.checksum == unordered.checksum ? 0 : 1;
+}
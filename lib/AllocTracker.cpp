@@ -0,0 +1,194 @@
+#include "AllocTracker.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <stdlib.h>
+
+#ifdef __APPLE__
+#include <malloc/malloc.h>
+#else
+#include <malloc.h>
+#endif
+
+namespace {
+
+// Constant-initialized so that no TLS guard runs inside operator new
+thread_local AllocTracker::Counters threadCounters;
+
+inline size_t usableSize(void* ptr) {
+#ifdef __APPLE__
+    return malloc_size(ptr);
+#else
+    return malloc_usable_size(ptr);
+#endif
+}
+
+inline void recordAlloc(void* ptr) {
+    const size_t size = usableSize(ptr);
+    AllocTracker::Counters& counters = threadCounters;
+    counters.allocCount++;
+    counters.allocBytes += size;
+    counters.liveBytes += size;
+    counters.peakLiveBytes = std::max(counters.peakLiveBytes, counters.liveBytes);
+}
+
+inline void recordFree(void* ptr) {
+    const size_t size = usableSize(ptr);
+    AllocTracker::Counters& counters = threadCounters;
+    counters.freedBytes += size;
+    counters.liveBytes -= size;
+}
+
+void* allocate(size_t size, size_t alignment) {
+    size = size == 0 ? 1 : size;
+
+    for (;;) {
+        void* ptr = nullptr;
+        if (alignment <= alignof(std::max_align_t)) {
+            ptr = malloc(size);
+        } else if (posix_memalign(&ptr, alignment, size) != 0) {
+            ptr = nullptr;
+        }
+
+        if (ptr) {
+            [[likely]]
+            recordAlloc(ptr);
+            return ptr;
+        }
+
+        const std::new_handler handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+
+        handler();
+    }
+}
+
+void* allocateNoThrow(size_t size, size_t alignment) noexcept {
+    try {
+        return allocate(size, alignment);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void deallocate(void* ptr) noexcept {
+    if (!ptr) {
+        return;
+    }
+
+    recordFree(ptr);
+    free(ptr);
+}
+
+}
+
+AllocTracker::Counters AllocTracker::getThreadCounters() {
+    return threadCounters;
+}
+
+void AllocTracker::beginScope(Scope& scope) {
+    scope.start = threadCounters;
+    scope.savedPeak = threadCounters.peakLiveBytes;
+    threadCounters.peakLiveBytes = threadCounters.liveBytes;
+}
+
+AllocTracker::Delta AllocTracker::endScope(const Scope& scope) {
+    Counters& counters = threadCounters;
+    const Counters& start = scope.start;
+
+    const Delta delta {
+        .allocCount = counters.allocCount - start.allocCount,
+        .allocBytes = counters.allocBytes - start.allocBytes,
+        .freedBytes = counters.freedBytes - start.freedBytes,
+        .peakBytes = (uint64_t)std::max<int64_t>(0, counters.peakLiveBytes - start.liveBytes),
+    };
+
+    counters.peakLiveBytes = std::max(scope.savedPeak, counters.peakLiveBytes);
+
+    return delta;
+}
+
+// Replaceable global allocation functions
+
+void* operator new(size_t size) {
+    return allocate(size, 0);
+}
+
+void* operator new[](size_t size) {
+    return allocate(size, 0);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    return allocate(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return allocate(size, (size_t)alignment);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return allocateNoThrow(size, 0);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return allocateNoThrow(size, 0);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocateNoThrow(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocateNoThrow(size, (size_t)alignment);
+}
+
+void operator delete(void* ptr) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+    deallocate(ptr);
+}
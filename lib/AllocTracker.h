@@ -0,0 +1,50 @@
+#pragma once
+
+#ifndef TURING_ALLOC_TRACKING
+#define TURING_ALLOC_TRACKING 0
+#endif
+
+#include <stdint.h>
+
+// Thread-local heap accounting through replaced global operator new/delete.
+// AllocTracker.cpp, which holds the replacements, is only compiled when the
+// library is built with TURING_ALLOC_TRACKING=1. Otherwise callers must not
+// reference the functions below, guard them with `if constexpr (AllocTracker::enabled)`.
+// Sizes are the usable sizes of the blocks returned by malloc.
+class AllocTracker {
+public:
+    static constexpr bool enabled = TURING_ALLOC_TRACKING;
+
+    struct Counters {
+        uint64_t allocCount {0};
+        uint64_t allocBytes {0};
+        uint64_t freedBytes {0};
+
+        // Bytes allocated minus bytes freed by this thread
+        int64_t liveBytes {0};
+        int64_t peakLiveBytes {0};
+    };
+
+    // Allocations done between beginScope and endScope
+    struct Delta {
+        uint64_t allocCount {0};
+        uint64_t allocBytes {0};
+        uint64_t freedBytes {0};
+
+        // Highest live bytes reached above the live bytes at the beginning
+        uint64_t peakBytes {0};
+    };
+
+    struct Scope {
+        Counters start;
+        int64_t savedPeak {0};
+    };
+
+    static Counters getThreadCounters();
+
+    // Scopes must be strictly nested on a thread
+    static void beginScope(Scope& scope);
+    static Delta endScope(const Scope& scope);
+
+    AllocTracker() = delete;
+};
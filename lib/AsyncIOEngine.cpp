@@ -0,0 +1,595 @@
+#include "AsyncIOEngine.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+#include "FileUtils.h"
+
+namespace {
+
+// Larger requests are split by the kernel anyway, and the length of an
+// io_uring request is 32 bits
+constexpr size_t MAX_OPERATION_SIZE = 0x7FFFF000;
+
+#ifdef __linux__
+
+unsigned loadAcquire(unsigned* ptr) {
+    return std::atomic_ref<unsigned>(*ptr).load(std::memory_order_acquire);
+}
+
+void storeRelease(unsigned* ptr, unsigned value) {
+    std::atomic_ref<unsigned>(*ptr).store(value, std::memory_order_release);
+}
+
+#endif
+
+}
+
+struct AsyncIOEngine::Operation {
+    bool write {false};
+    int fd {-1};
+    void* buffer {nullptr};
+    size_t size {0};
+    uint64_t offset {0};
+    int bufferIndex {-1};
+};
+
+struct AsyncIOEngine::Completion {
+    uint32_t slot {0};
+    ssize_t result {0};
+};
+
+#ifdef __linux__
+
+// io_uring instance set up with raw system calls: the submission queue,
+// completion queue and submission entries are mapped from the ring fd
+class AsyncIOEngine::Ring {
+public:
+    ~Ring() {
+        if (_sqes) {
+            munmap(_sqes, _sqesSize);
+        }
+
+        if (_cqRing && _cqRing != _sqRing) {
+            munmap(_cqRing, _cqRingSize);
+        }
+
+        if (_sqRing) {
+            munmap(_sqRing, _sqRingSize);
+        }
+
+        if (_fd >= 0) {
+            close(_fd);
+        }
+    }
+
+    bool setup(unsigned entries) {
+        io_uring_params params {};
+        params.flags = IORING_SETUP_CLAMP;
+
+        _fd = syscall(__NR_io_uring_setup, entries, &params);
+        if (_fd < 0) {
+            return false;
+        }
+
+        // IORING_OP_READ and IORING_OP_WRITE came with this feature in 5.6
+        if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+            return false;
+        }
+
+        _sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        _cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+        const bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMap) {
+            _sqRingSize = std::max(_sqRingSize, _cqRingSize);
+            _cqRingSize = _sqRingSize;
+        }
+
+        _sqRing = map(_sqRingSize, IORING_OFF_SQ_RING);
+        if (!_sqRing) {
+            return false;
+        }
+
+        _cqRing = singleMap ? _sqRing : map(_cqRingSize, IORING_OFF_CQ_RING);
+        if (!_cqRing) {
+            return false;
+        }
+
+        _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        _sqes = static_cast<io_uring_sqe*>(map(_sqesSize, IORING_OFF_SQES));
+        if (!_sqes) {
+            return false;
+        }
+
+        char* sq = static_cast<char*>(_sqRing);
+        _sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        _sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        _sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+        char* cq = static_cast<char*>(_cqRing);
+        _cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        _cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        _cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        _cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        _entries = params.sq_entries;
+        return true;
+    }
+
+    unsigned entries() const { return _entries; }
+
+    // The engine never has more operations in flight than entries,
+    // so there is always a free submission entry
+    void push(const Operation& op, uint32_t slot) {
+        const unsigned tail = *_sqTail;
+        const unsigned index = tail & _sqMask;
+
+        io_uring_sqe* sqe = &_sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+
+        if (op.bufferIndex >= 0) {
+            sqe->opcode = op.write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+            sqe->buf_index = op.bufferIndex;
+        } else {
+            sqe->opcode = op.write ? IORING_OP_WRITE : IORING_OP_READ;
+        }
+
+        sqe->fd = op.fd;
+        sqe->addr = reinterpret_cast<uint64_t>(op.buffer);
+        sqe->len = std::min(op.size, MAX_OPERATION_SIZE);
+        sqe->off = op.offset;
+        sqe->user_data = slot;
+
+        _sqArray[index] = index;
+        storeRelease(_sqTail, tail + 1);
+        _pending++;
+    }
+
+    // Submits the pending entries and waits for minComplete completions
+    void enter(unsigned minComplete) {
+        if (_pending == 0 && minComplete == 0) {
+            return;
+        }
+
+        const unsigned flags = minComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+        for (;;) {
+            const int res = syscall(__NR_io_uring_enter, _fd, _pending, minComplete, flags, nullptr, 0);
+            if (res >= 0) {
+                _pending -= std::min<unsigned>(res, _pending);
+                if (_pending == 0 || minComplete > 0) {
+                    return;
+                }
+                continue;
+            }
+
+            // Completions waiting to be reaped are not an error, EINTR and
+            // EAGAIN only delay the submission
+            if (errno == EBUSY || (errno != EINTR && errno != EAGAIN)) {
+                return;
+            }
+        }
+    }
+
+    void reap(std::vector<Completion>& completions) {
+        unsigned head = *_cqHead;
+        const unsigned tail = loadAcquire(_cqTail);
+
+        while (head != tail) {
+            const io_uring_cqe& cqe = _cqes[head & _cqMask];
+            completions.push_back({(uint32_t)cqe.user_data, cqe.res});
+            head++;
+        }
+
+        storeRelease(_cqHead, head);
+    }
+
+    bool registerBuffers(std::span<const std::span<char>> buffers) {
+        syscall(__NR_io_uring_register, _fd, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+        if (buffers.empty()) {
+            return true;
+        }
+
+        std::vector<iovec> iovecs;
+        iovecs.reserve(buffers.size());
+        for (const std::span<char> buffer : buffers) {
+            iovecs.push_back({buffer.data(), buffer.size()});
+        }
+
+        return syscall(__NR_io_uring_register, _fd, IORING_REGISTER_BUFFERS,
+                       iovecs.data(), (unsigned)iovecs.size()) == 0;
+    }
+
+private:
+    int _fd {-1};
+    unsigned _entries {0};
+    unsigned _pending {0};
+
+    void* _sqRing {nullptr};
+    size_t _sqRingSize {0};
+    void* _cqRing {nullptr};
+    size_t _cqRingSize {0};
+    io_uring_sqe* _sqes {nullptr};
+    size_t _sqesSize {0};
+
+    unsigned* _sqTail {nullptr};
+    unsigned _sqMask {0};
+    unsigned* _sqArray {nullptr};
+    unsigned* _cqHead {nullptr};
+    unsigned* _cqTail {nullptr};
+    unsigned _cqMask {0};
+    io_uring_cqe* _cqes {nullptr};
+
+    void* map(size_t size, off_t offset) {
+        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, offset);
+        return ptr == MAP_FAILED ? nullptr : ptr;
+    }
+};
+
+#else
+
+// io_uring is Linux only, the engine always runs on the thread pool
+class AsyncIOEngine::Ring {
+public:
+    unsigned entries() const { return 0; }
+    void push(const Operation&, uint32_t) {}
+    void enter(unsigned) {}
+    void reap(std::vector<Completion>&) {}
+    bool registerBuffers(std::span<const std::span<char>>) { return false; }
+};
+
+#endif
+
+// Workers running the operations with pread and pwrite. Completions are
+// queued for the thread of the engine, which runs the callbacks
+class AsyncIOEngine::ThreadPool {
+public:
+    explicit ThreadPool(unsigned threadCount) {
+        for (unsigned i = 0; i < threadCount; i++) {
+            _workers.emplace_back([this] { run(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(_mutex);
+            _stopping = true;
+        }
+        _taskCond.notify_all();
+
+        for (std::thread& worker : _workers) {
+            worker.join();
+        }
+    }
+
+    void push(const Operation& op, uint32_t slot) {
+        {
+            std::lock_guard lock(_mutex);
+            _tasks.push_back({op, slot});
+        }
+        _taskCond.notify_one();
+    }
+
+    void reap(std::vector<Completion>& completions, bool wait) {
+        std::unique_lock lock(_mutex);
+        if (wait) {
+            _doneCond.wait(lock, [this] { return !_done.empty(); });
+        }
+
+        completions.insert(completions.end(), _done.begin(), _done.end());
+        _done.clear();
+    }
+
+private:
+    struct Task {
+        Operation op;
+        uint32_t slot {0};
+    };
+
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _taskCond;
+    std::condition_variable _doneCond;
+    std::deque<Task> _tasks;
+    std::vector<Completion> _done;
+    bool _stopping {false};
+
+    void run() {
+        for (;;) {
+            Task task;
+            {
+                std::unique_lock lock(_mutex);
+                _taskCond.wait(lock, [this] { return _stopping || !_tasks.empty(); });
+                if (_tasks.empty()) {
+                    return;
+                }
+
+                task = _tasks.front();
+                _tasks.pop_front();
+            }
+
+            const ssize_t result = execute(task.op);
+
+            {
+                std::lock_guard lock(_mutex);
+                _done.push_back({task.slot, result});
+            }
+            _doneCond.notify_one();
+        }
+    }
+
+    static ssize_t execute(const Operation& op) {
+        const size_t size = std::min(op.size, MAX_OPERATION_SIZE);
+        for (;;) {
+            const ssize_t res = op.write
+                              ? pwrite(op.fd, op.buffer, size, op.offset)
+                              : pread(op.fd, op.buffer, size, op.offset);
+            if (res >= 0) {
+                return res;
+            }
+
+            if (errno != EINTR) {
+                return -errno;
+            }
+        }
+    }
+};
+
+AsyncIOEngine::AsyncIOEngine(Options options)
+    : _queueDepth(std::max(1u, options.queueDepth))
+{
+#ifdef __linux__
+    const char* requested = getenv("TURING_ASYNC_IO");
+    const bool forceThreadPool = options.forceThreadPool
+                              || (requested && std::string_view(requested) == "threads");
+
+    if (!forceThreadPool) {
+        auto ring = std::make_unique<Ring>();
+        if (ring->setup(_queueDepth)) {
+            _queueDepth = std::min(_queueDepth, ring->entries());
+            _ring = std::move(ring);
+        }
+    }
+#endif
+
+    if (!_ring) {
+        _pool = std::make_unique<ThreadPool>(std::max(1u, options.threadCount));
+    }
+
+    _callbacks.resize(_queueDepth);
+    _freeSlots.reserve(_queueDepth);
+    for (uint32_t slot = _queueDepth; slot > 0; slot--) {
+        _freeSlots.push_back(slot - 1);
+    }
+}
+
+AsyncIOEngine::~AsyncIOEngine() {
+    drain();
+}
+
+void AsyncIOEngine::read(int fd, void* buffer, size_t size, uint64_t offset, Callback callback) {
+    enqueue({false, fd, buffer, size, offset, -1}, std::move(callback));
+}
+
+void AsyncIOEngine::write(int fd, const void* buffer, size_t size, uint64_t offset, Callback callback) {
+    enqueue({true, fd, const_cast<void*>(buffer), size, offset, -1}, std::move(callback));
+}
+
+std::future<ssize_t> AsyncIOEngine::read(int fd, void* buffer, size_t size, uint64_t offset) {
+    auto promise = std::make_shared<std::promise<ssize_t>>();
+    std::future<ssize_t> future = promise->get_future();
+    read(fd, buffer, size, offset, [promise](ssize_t result) { promise->set_value(result); });
+    return future;
+}
+
+std::future<ssize_t> AsyncIOEngine::write(int fd, const void* buffer, size_t size, uint64_t offset) {
+    auto promise = std::make_shared<std::promise<ssize_t>>();
+    std::future<ssize_t> future = promise->get_future();
+    write(fd, buffer, size, offset, [promise](ssize_t result) { promise->set_value(result); });
+    return future;
+}
+
+bool AsyncIOEngine::registerBuffers(std::span<const std::span<char>> buffers) {
+    if (!_ring) {
+        return true;
+    }
+
+    // Registration is refused while operations are in flight
+    drain();
+    return _ring->registerBuffers(buffers);
+}
+
+void AsyncIOEngine::readFixed(int fd, unsigned bufferIndex, void* buffer, size_t size,
+                              uint64_t offset, Callback callback) {
+    enqueue({false, fd, buffer, size, offset, (int)bufferIndex}, std::move(callback));
+}
+
+void AsyncIOEngine::writeFixed(int fd, unsigned bufferIndex, const void* buffer, size_t size,
+                               uint64_t offset, Callback callback) {
+    enqueue({true, fd, const_cast<void*>(buffer), size, offset, (int)bufferIndex}, std::move(callback));
+}
+
+void AsyncIOEngine::enqueue(const Operation& op, Callback callback) {
+    while (_freeSlots.empty()) {
+        wait();
+    }
+
+    const uint32_t slot = _freeSlots.back();
+    _freeSlots.pop_back();
+    _callbacks[slot] = std::move(callback);
+    _inFlight++;
+
+    if (_ring) {
+        _ring->push(op, slot);
+    } else {
+        Operation poolOp = op;
+        poolOp.bufferIndex = -1;
+        _pool->push(poolOp, slot);
+    }
+}
+
+void AsyncIOEngine::submit() {
+    if (_ring) {
+        _ring->enter(0);
+    }
+}
+
+size_t AsyncIOEngine::poll() {
+    if (_ring) {
+        _ring->enter(0);
+        _ring->reap(_completions);
+    } else {
+        _pool->reap(_completions, false);
+    }
+
+    return complete();
+}
+
+size_t AsyncIOEngine::wait() {
+    if (_inFlight == 0) {
+        return 0;
+    }
+
+    if (_ring) {
+        _ring->reap(_completions);
+        _ring->enter(_completions.empty() ? 1 : 0);
+        _ring->reap(_completions);
+    } else {
+        _pool->reap(_completions, true);
+    }
+
+    return complete();
+}
+
+void AsyncIOEngine::drain() {
+    while (_inFlight > 0) {
+        wait();
+    }
+}
+
+ssize_t AsyncIOEngine::get(std::future<ssize_t>& future) {
+    while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        if (_inFlight == 0) {
+            break;
+        }
+        wait();
+    }
+
+    return future.get();
+}
+
+size_t AsyncIOEngine::complete() {
+    // Callbacks may submit operations, which must not disturb this list
+    std::vector<Completion> completions;
+    completions.swap(_completions);
+
+    for (const Completion& completion : completions) {
+        // The slot is released before the callback so that it can
+        // submit an operation without waiting
+        Callback callback = std::move(_callbacks[completion.slot]);
+        _callbacks[completion.slot] = nullptr;
+        _freeSlots.push_back(completion.slot);
+        _inFlight--;
+
+        if (callback) {
+            callback(completion.result);
+        }
+    }
+
+    return completions.size();
+}
+
+bool AsyncIOEngine::readFiles(std::span<const Path> paths, std::vector<std::string>& contents) {
+    contents.clear();
+    contents.resize(paths.size());
+
+    struct FileRead {
+        int fd {-1};
+        size_t done {0};
+    };
+
+    std::vector<FileRead> files(paths.size());
+    bool success = true;
+
+    // Reads the rest of file i, or closes it when complete
+    std::function<void(size_t)> readNext = [&](size_t i) {
+        FileRead& file = files[i];
+        std::string& content = contents[i];
+
+        if (file.done == content.size()) {
+            close(file.fd);
+            file.fd = -1;
+            return;
+        }
+
+        read(file.fd, content.data() + file.done, content.size() - file.done, file.done,
+             [&, i](ssize_t result) {
+                 if (result < 0 || !success) {
+                     success = false;
+                     close(files[i].fd);
+                     files[i].fd = -1;
+                     return;
+                 }
+
+                 if (result == 0) {
+                     // The file was truncated meanwhile
+                     contents[i].resize(files[i].done);
+                 }
+
+                 files[i].done += result;
+                 readNext(i);
+             });
+    };
+
+    for (size_t i = 0; i < paths.size() && success; i++) {
+        const int fd = open(paths[i].string().c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            success = false;
+            break;
+        }
+
+        struct stat statBuf;
+        if (fstat(fd, &statBuf) != 0 || !S_ISREG(statBuf.st_mode)) {
+            close(fd);
+            success = false;
+            break;
+        }
+
+        if (statBuf.st_size == 0) {
+            // Files without a size, e.g. in /proc, are read until the end
+            close(fd);
+            success = FileUtils::readContent(paths[i], contents[i]);
+            continue;
+        }
+
+        files[i].fd = fd;
+        contents[i].resize(statBuf.st_size);
+        readNext(i);
+        poll();
+    }
+
+    // Every opened file is closed by the completion of its last read
+    drain();
+
+    return success;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+struct AsyncIOEngineOptions {
+    // Maximum number of operations in flight, submitting more waits
+    // for completions
+    unsigned queueDepth {64};
+
+    // Workers of the thread pool used when io_uring is unavailable
+    unsigned threadCount {4};
+
+    bool forceThreadPool {false};
+};
+
+// Asynchronous positional reads and writes of file descriptors.
+//
+// Operations are queued and submitted to io_uring in batches, on submit or
+// when completions are awaited. io_uring is driven with raw system calls.
+// Without io_uring (systems other than Linux, kernels before 5.6, seccomp
+// filters), or with TURING_ASYNC_IO=threads, operations run with pread and
+// pwrite on a small pool of blocking threads.
+//
+// A completion delivers the result of pread or pwrite: the byte count, which
+// may be short, or -errno. Callbacks always run on the thread that calls
+// poll, wait, drain or get, never on a worker, and may submit operations.
+// Futures are fulfilled the same way, wait on them with get.
+// The engine itself is not thread-safe. Buffers must stay valid until the
+// completion of their operation, the destructor drains the engine.
+class AsyncIOEngine {
+public:
+    using Path = std::filesystem::path;
+    using Callback = std::function<void(ssize_t result)>;
+    using Options = AsyncIOEngineOptions;
+
+    enum class Backend {
+        IOUring,
+        ThreadPool,
+    };
+
+    explicit AsyncIOEngine(Options options = {});
+    ~AsyncIOEngine();
+
+    AsyncIOEngine(const AsyncIOEngine&) = delete;
+    AsyncIOEngine(AsyncIOEngine&&) = delete;
+    AsyncIOEngine& operator=(const AsyncIOEngine&) = delete;
+    AsyncIOEngine& operator=(AsyncIOEngine&&) = delete;
+
+    Backend backend() const { return _ring ? Backend::IOUring : Backend::ThreadPool; }
+    unsigned queueDepth() const { return _queueDepth; }
+    size_t inFlight() const { return _inFlight; }
+
+    void read(int fd, void* buffer, size_t size, uint64_t offset, Callback callback);
+    void write(int fd, const void* buffer, size_t size, uint64_t offset, Callback callback);
+
+    std::future<ssize_t> read(int fd, void* buffer, size_t size, uint64_t offset);
+    std::future<ssize_t> write(int fd, const void* buffer, size_t size, uint64_t offset);
+
+    // Registers buffers with the kernel so that the fixed operations skip
+    // mapping them at each call. Replaces the previous registration.
+    // With the thread pool, fixed operations are plain ones
+    bool registerBuffers(std::span<const std::span<char>> buffers);
+
+    // buffer must lie within the registered buffer at bufferIndex
+    void readFixed(int fd, unsigned bufferIndex, void* buffer, size_t size,
+                   uint64_t offset, Callback callback);
+    void writeFixed(int fd, unsigned bufferIndex, const void* buffer, size_t size,
+                    uint64_t offset, Callback callback);
+
+    // Hands the queued operations to the kernel without waiting
+    void submit();
+
+    // Runs the callbacks of the completed operations, returns their number
+    size_t poll();
+
+    // Waits for at least one completion if any operation is in flight
+    size_t wait();
+
+    // Waits for all the operations in flight
+    void drain();
+
+    // Waits for the operation of future, completing others meanwhile
+    ssize_t get(std::future<ssize_t>& future);
+
+    // Reads whole files concurrently, keeping up to queueDepth reads in
+    // flight. contents[i] receives the content of paths[i]. Returns false
+    // if a file could not be read
+    bool readFiles(std::span<const Path> paths, std::vector<std::string>& contents);
+
+private:
+    struct Operation;
+    struct Completion;
+    class Ring;
+    class ThreadPool;
+
+    unsigned _queueDepth {0};
+    size_t _inFlight {0};
+    std::vector<Callback> _callbacks;
+    std::vector<uint32_t> _freeSlots;
+    std::vector<Completion> _completions;
+    std::unique_ptr<Ring> _ring;
+    std::unique_ptr<ThreadPool> _pool;
+
+    void enqueue(const Operation& op, Callback callback);
+    size_t complete();
+};
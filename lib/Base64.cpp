@@ -0,0 +1,700 @@
+#include "Base64.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "BioAssert.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Kernels process the input in blocks while it is safe to load and store full
+// vectors, and return the number of input bytes consumed. The scalar code of
+// Base64 finishes the remaining bytes. Decode kernels stop at the first block
+// holding an invalid character, the scalar code then reports the error.
+using EncodeKernel = size_t (*)(const uint8_t* src, size_t len, char* dst);
+using DecodeKernel = size_t (*)(const char* src, size_t len, uint8_t* dst);
+
+struct Kernels {
+    const char* name {nullptr};
+    EncodeKernel encode {nullptr};
+    DecodeKernel decode {nullptr};
+};
+
+size_t encodeScalar(const uint8_t*, size_t, char*) {
+    return 0;
+}
+
+size_t decodeScalar(const char*, size_t, uint8_t*) {
+    return 0;
+}
+
+#if defined(__x86_64__)
+
+constexpr std::string_view ALPHABET = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Value of each ASCII character, 0x80 for the characters outside the alphabet
+constexpr std::array<int8_t, 128> makeDecodeLookup() {
+    std::array<int8_t, 128> lookup {};
+    lookup.fill(-128);
+    for (size_t i = 0; i < ALPHABET.size(); i++) {
+        lookup[ALPHABET[i]] = i;
+    }
+    return lookup;
+}
+
+alignas(64) constexpr std::array<int8_t, 128> DECODE_LOOKUP = makeDecodeLookup();
+
+// Gathers the 3 big-endian bytes of each decoded 32-bit word
+constexpr std::array<int8_t, 64> makeDecodePack() {
+    std::array<int8_t, 64> pack {};
+    for (size_t i = 0; i < 48; i++) {
+        pack[i] = (i / 3) * 4 + 2 - (i % 3);
+    }
+    return pack;
+}
+
+alignas(64) constexpr std::array<int8_t, 64> DECODE_PACK = makeDecodePack();
+
+// The encode kernels rearrange each group of 3 input bytes a, b, c into the
+// 32-bit word [b, a, c, b], from which the 4 6-bit indices are extracted with
+// multiplications. The decode kernels merge the 4 6-bit values of each 32-bit
+// word with multiply-adds. See W. Mula and D. Lemire, "Faster Base64 Encoding
+// and Decoding using AVX2 Instructions" and "Base64 encoding and decoding at
+// almost the speed of a memory copy".
+
+[[gnu::target("ssse3")]]
+inline __m128i encodeIndices128(__m128i in) {
+    in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+}
+
+// Adds to each index the offset of its range of the alphabet
+[[gnu::target("ssse3")]]
+inline __m128i encodeLookup128(__m128i indices) {
+    const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                          '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                          '/' - 63, 'A', 0, 0);
+    __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    const __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+    return _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, range));
+}
+
+[[gnu::target("ssse3")]]
+size_t encodeSSSE3(const uint8_t* src, size_t len, char* dst) {
+    const uint8_t* start = src;
+
+    // Loads 16 bytes to encode 12
+    while (len >= 16) {
+        const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        const __m128i out = encodeLookup128(encodeIndices128(in));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), out);
+
+        src += 12;
+        dst += 16;
+        len -= 12;
+    }
+
+    return src - start;
+}
+
+// Checks the characters and translates them to their 6-bit values.
+// Returns false if a character is outside the alphabet.
+[[gnu::target("ssse3")]]
+inline bool decodeValues128(__m128i& str) {
+    const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                          0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask2F = _mm_set1_epi8(0x2F);
+
+    const __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask2F);
+    const __m128i loNibbles = _mm_and_si128(str, mask2F);
+    const __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+    const __m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+
+    const __m128i invalid = _mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128());
+    if (_mm_movemask_epi8(invalid) != 0xFFFF) {
+        return false;
+    }
+
+    const __m128i eq2F = _mm_cmpeq_epi8(str, mask2F);
+    const __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(eq2F, hiNibbles));
+    str = _mm_add_epi8(str, roll);
+
+    return true;
+}
+
+[[gnu::target("ssse3")]]
+size_t decodeSSSE3(const char* src, size_t len, uint8_t* dst) {
+    const char* start = src;
+
+    // Stores 16 bytes for 12 decoded, the following characters
+    // guarantee that the 4 extra bytes stay inside the output
+    while (len >= 16 + 4) {
+        __m128i str = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        if (!decodeValues128(str)) {
+            break;
+        }
+
+        const __m128i merged = _mm_madd_epi16(_mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140)),
+                                              _mm_set1_epi32(0x00011000));
+        const __m128i out = _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+                                                                   14, 13, 12, -1, -1, -1, -1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), out);
+
+        src += 16;
+        dst += 12;
+        len -= 16;
+    }
+
+    return src - start;
+}
+
+[[gnu::target("avx2")]]
+size_t encodeAVX2(const uint8_t* src, size_t len, char* dst) {
+    const uint8_t* start = src;
+
+    const __m256i shuffle = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                             1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                             '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                             '/' - 63, 'A', 0, 0,
+                                             'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                             '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                             '/' - 63, 'A', 0, 0);
+
+    // Each lane loads 16 bytes to encode 12
+    while (len >= 12 + 16) {
+        const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 12));
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+
+        in = _mm256_shuffle_epi8(in, shuffle);
+        const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+        const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+        const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        const __m256i indices = _mm256_or_si256(t1, t3);
+
+        __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        const __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+        range = _mm256_or_si256(range, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+        const __m256i out = _mm256_add_epi8(indices, _mm256_shuffle_epi8(offsets, range));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), out);
+
+        src += 24;
+        dst += 32;
+        len -= 24;
+    }
+
+    return src - start;
+}
+
+[[gnu::target("avx2")]]
+size_t decodeAVX2(const char* src, size_t len, uint8_t* dst) {
+    const char* start = src;
+
+    const __m256i lutLo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                           0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                           0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                           0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lutHi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                           0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                           0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                           0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lutRoll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                             0, 0, 0, 0, 0, 0, 0, 0,
+                                             0, 16, 19, 4, -65, -65, -71, -71,
+                                             0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask2F = _mm256_set1_epi8(0x2F);
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    // Stores 32 bytes for 24 decoded, the following characters
+    // guarantee that the 8 extra bytes stay inside the output
+    while (len >= 32 + 12) {
+        __m256i str = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+
+        const __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask2F);
+        const __m256i loNibbles = _mm256_and_si256(str, mask2F);
+        const __m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+        const __m256i lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+        if (!_mm256_testz_si256(lo, hi)) {
+            break;
+        }
+
+        const __m256i eq2F = _mm256_cmpeq_epi8(str, mask2F);
+        const __m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(eq2F, hiNibbles));
+        str = _mm256_add_epi8(str, roll);
+
+        const __m256i merged = _mm256_madd_epi16(_mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140)),
+                                                 _mm256_set1_epi32(0x00011000));
+        __m256i out = _mm256_shuffle_epi8(merged, pack);
+        out = _mm256_permutevar8x32_epi32(out, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), out);
+
+        src += 32;
+        dst += 24;
+        len -= 32;
+    }
+
+    return src - start;
+}
+
+#define AVX512_VBMI_TARGET gnu::target("avx512f,avx512bw,avx512vbmi")
+
+// The unmasked forms of some intrinsics trigger -Wmaybe-uninitialized in GCC 12
+constexpr __mmask64 ALL_LANES = ~0ull;
+
+[[AVX512_VBMI_TARGET]]
+size_t encodeAVX512(const uint8_t* src, size_t len, char* dst) {
+    const uint8_t* start = src;
+
+    const __m512i shuffle = _mm512_setr_epi32(0x01020001, 0x04050304, 0x07080607, 0x0a0b090a,
+                                              0x0d0e0c0d, 0x10110f10, 0x13141213, 0x16171516,
+                                              0x191a1819, 0x1c1d1b1c, 0x1f201e1f, 0x22232122,
+                                              0x25262425, 0x28292728, 0x2b2c2a2b, 0x2e2f2d2e);
+    const __m512i shifts = _mm512_set1_epi64(0x3036242a1016040a);
+    const __m512i alphabet = _mm512_loadu_si512(ALPHABET.data());
+
+    // Masked loads of 48 bytes encoded into 64 characters
+    while (len >= 48) {
+        const __m512i in = _mm512_maskz_loadu_epi8(0x0000FFFFFFFFFFFFull, src);
+        const __m512i words = _mm512_maskz_permutexvar_epi8(ALL_LANES, shuffle, in);
+        const __m512i indices = _mm512_maskz_multishift_epi64_epi8(ALL_LANES, shifts, words);
+        const __m512i out = _mm512_maskz_permutexvar_epi8(ALL_LANES, indices, alphabet);
+        _mm512_storeu_si512(dst, out);
+
+        src += 48;
+        dst += 64;
+        len -= 48;
+    }
+
+    return src - start;
+}
+
+[[AVX512_VBMI_TARGET]]
+size_t decodeAVX512(const char* src, size_t len, uint8_t* dst) {
+    const char* start = src;
+
+    const __m512i lookup0 = _mm512_load_si512(DECODE_LOOKUP.data());
+    const __m512i lookup1 = _mm512_load_si512(DECODE_LOOKUP.data() + 64);
+    const __m512i pack = _mm512_load_si512(DECODE_PACK.data());
+
+    // 64 characters decoded into 48 bytes with a masked store
+    while (len >= 64) {
+        const __m512i str = _mm512_loadu_si512(src);
+
+        // Characters >= 0x80 and outside the alphabet have their sign bit set
+        const __m512i values = _mm512_permutex2var_epi8(lookup0, str, lookup1);
+        if (_mm512_movepi8_mask(_mm512_or_si512(values, str)) != 0) {
+            break;
+        }
+
+        const __m512i merged = _mm512_madd_epi16(_mm512_maddubs_epi16(values, _mm512_set1_epi32(0x01400140)),
+                                                 _mm512_set1_epi32(0x00011000));
+        const __m512i out = _mm512_maskz_permutexvar_epi8(ALL_LANES, pack, merged);
+        _mm512_mask_storeu_epi8(dst, 0x0000FFFFFFFFFFFFull, out);
+
+        src += 64;
+        dst += 48;
+        len -= 64;
+    }
+
+    return src - start;
+}
+
+#undef AVX512_VBMI_TARGET
+
+#endif
+
+constexpr Kernels SCALAR_KERNELS {"scalar", encodeScalar, decodeScalar};
+
+Kernels selectKernels() {
+#if defined(__x86_64__)
+    const Kernels available[] = {
+        {"avx512", encodeAVX512, decodeAVX512},
+        {"avx2", encodeAVX2, decodeAVX2},
+        {"ssse3", encodeSSSE3, decodeSSSE3},
+    };
+
+    const bool supported[] = {
+        __builtin_cpu_supports("avx512f")
+            && __builtin_cpu_supports("avx512bw")
+            && __builtin_cpu_supports("avx512vbmi"),
+        (bool)__builtin_cpu_supports("avx2"),
+        (bool)__builtin_cpu_supports("ssse3"),
+    };
+
+    // Kernels at most as wide as the requested ones
+    const char* requested = getenv("TURING_BASE64_ISA");
+    bool allowed = !requested;
+
+    for (size_t i = 0; i < std::size(available); i++) {
+        allowed = allowed || std::string_view(requested) == available[i].name;
+        if (allowed && supported[i]) {
+            return available[i];
+        }
+    }
+#endif
+
+    return SCALAR_KERNELS;
+}
+
+const Kernels& getKernels() {
+    static const Kernels kernels = selectKernels();
+    return kernels;
+}
+
+// Below this many input bytes per thread, starting the threads
+// costs more than encoding on a single core
+constexpr size_t PARALLEL_MIN_CHUNK = 1024 * 1024;
+
+size_t getParallelThreadCount(size_t len, size_t requested) {
+    const size_t count = requested ? requested : std::max(1u, std::thread::hardware_concurrency());
+    return std::max<size_t>(1, std::min(count, len / PARALLEL_MIN_CHUNK));
+}
+
+}
+
+std::size_t Base64::encode_to(const uint8_t* data, std::size_t len, char* out) noexcept {
+    char* const out_start = out;
+
+    const std::size_t consumed = getKernels().encode(data, len, out);
+    data += consumed;
+    out += consumed / 3 * 4;
+    len -= consumed;
+
+    const uint8_t* end = data + len;
+    const uint8_t* chunk_end = data + (len / 3) * 3;
+
+    while (data < chunk_end) {
+        const uint32_t chunk = (static_cast<uint32_t>(data[0]) << 16) |
+                               (static_cast<uint32_t>(data[1]) << 8) |
+                               static_cast<uint32_t>(data[2]);
+
+        out[0] = encode_table[(chunk >> 18) & 0x3F];
+        out[1] = encode_table[(chunk >> 12) & 0x3F];
+        out[2] = encode_table[(chunk >> 6) & 0x3F];
+        out[3] = encode_table[chunk & 0x3F];
+
+        data += 3;
+        out += 4;
+    }
+
+    // Handle remaining 1-2 bytes
+    if (data < end) {
+        uint32_t chunk = static_cast<uint32_t>(data[0]) << 16;
+        if (data + 1 < end) {
+            chunk |= static_cast<uint32_t>(data[1]) << 8;
+        }
+
+        out[0] = encode_table[(chunk >> 18) & 0x3F];
+        out[1] = encode_table[(chunk >> 12) & 0x3F];
+        out[2] = (data + 1 < end) ? encode_table[(chunk >> 6) & 0x3F] : '=';
+        out[3] = '=';
+        out += 4;
+    }
+
+    return out - out_start;
+}
+
+bool Base64::decode_to(const char* data, std::size_t len, uint8_t* out, std::size_t& out_len) noexcept {
+    out_len = 0;
+
+    if (len % 4 != 0) {
+        return false;
+    }
+
+    if (len == 0) {
+        return true;
+    }
+
+    uint8_t* const out_start = out;
+
+    // The last quad is the only one that may hold padding,
+    // it is left to the scalar code
+    const std::size_t consumed = getKernels().decode(data, len - 4, out);
+    data += consumed;
+    out += consumed / 4 * 3;
+
+    const char* last = data + (len - consumed) - 4;
+
+    while (data < last) {
+        const uint8_t a = decode_table[static_cast<uint8_t>(data[0])];
+        const uint8_t b = decode_table[static_cast<uint8_t>(data[1])];
+        const uint8_t c = decode_table[static_cast<uint8_t>(data[2])];
+        const uint8_t d = decode_table[static_cast<uint8_t>(data[3])];
+
+        // Invalid characters and padding both have their high bits set
+        if ((a | b | c | d) & 0xC0) {
+            return false;
+        }
+
+        const uint32_t chunk = (static_cast<uint32_t>(a) << 18) |
+                               (static_cast<uint32_t>(b) << 12) |
+                               (static_cast<uint32_t>(c) << 6) |
+                               static_cast<uint32_t>(d);
+
+        out[0] = (chunk >> 16) & 0xFF;
+        out[1] = (chunk >> 8) & 0xFF;
+        out[2] = chunk & 0xFF;
+
+        data += 4;
+        out += 3;
+    }
+
+    const uint8_t a = decode_table[static_cast<uint8_t>(data[0])];
+    const uint8_t b = decode_table[static_cast<uint8_t>(data[1])];
+    const uint8_t c = decode_table[static_cast<uint8_t>(data[2])];
+    const uint8_t d = decode_table[static_cast<uint8_t>(data[3])];
+
+    // 254 = padding, only allowed in the last 2 positions,
+    // and the 3rd position can only be padding if the 4th is too
+    if ((a | b) & 0xC0 || c == 255 || d == 255 || (c == 254 && d != 254)) {
+        return false;
+    }
+
+    const uint32_t chunk = (static_cast<uint32_t>(a) << 18) |
+                           (static_cast<uint32_t>(b) << 12) |
+                           (static_cast<uint32_t>(c & 0x3F) << 6) |
+                           static_cast<uint32_t>(d & 0x3F);
+
+    *out++ = (chunk >> 16) & 0xFF;
+    if (c != 254) {
+        *out++ = (chunk >> 8) & 0xFF;
+        if (d != 254) {
+            *out++ = chunk & 0xFF;
+        }
+    }
+
+    out_len = out - out_start;
+    return true;
+}
+
+const char* Base64::kernel_name() noexcept {
+    return getKernels().name;
+}
+
+std::size_t Base64::encode_parallel(const uint8_t* data, std::size_t len, char* out,
+                                    std::size_t thread_count) {
+    const size_t threads = getParallelThreadCount(len, thread_count);
+    if (threads <= 1) {
+        return encode_to(data, len, out);
+    }
+
+    // All the chunks but the last one are a multiple of 3 bytes, without padding
+    const size_t chunk = (len / 3 / threads) * 3;
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+
+    for (size_t i = 0; i < threads - 1; i++) {
+        workers.emplace_back([=] {
+            encode_to(data + i * chunk, chunk, out + i * chunk / 3 * 4);
+        });
+    }
+
+    const size_t last = (threads - 1) * chunk;
+    encode_to(data + last, len - last, out + last / 3 * 4);
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    return encode_size(len);
+}
+
+bool Base64::decode_parallel(const char* data, std::size_t len, uint8_t* out, std::size_t& out_len,
+                             std::size_t thread_count) {
+    out_len = 0;
+
+    const size_t threads = getParallelThreadCount(len, thread_count);
+    if (threads <= 1 || len % 4 != 0) {
+        return decode_to(data, len, out, out_len);
+    }
+
+    // All the chunks but the last one are a multiple of 4 characters
+    // and decode to exactly 3 bytes per quad
+    const size_t chunk = (len / 4 / threads) * 4;
+    const std::unique_ptr<bool[]> valid(new bool[threads - 1]);
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+
+    for (size_t i = 0; i < threads - 1; i++) {
+        workers.emplace_back([=, &valid] {
+            const char* src = data + i * chunk;
+            size_t written = 0;
+
+            // Padding is only allowed at the very end
+            valid[i] = src[chunk - 1] != '=' && decode_to(src, chunk, out + i * chunk / 4 * 3, written);
+        });
+    }
+
+    const size_t last = (threads - 1) * chunk;
+    size_t lastWritten = 0;
+    bool allValid = decode_to(data + last, len - last, out + last / 4 * 3, lastWritten);
+
+    for (size_t i = 0; i < threads - 1; i++) {
+        workers[i].join();
+        allValid = allValid && valid[i];
+    }
+
+    if (!allValid) {
+        return false;
+    }
+
+    out_len = last / 4 * 3 + lastWritten;
+    return true;
+}
+
+std::size_t Base64Encoder::update(std::span<const uint8_t> in, std::span<char> out) {
+    bioassert(out.size() >= max_output_size(in.size()),
+              "Base64Encoder output of {} characters is too small for {} bytes",
+              out.size(), in.size());
+
+    const uint8_t* data = in.data();
+    std::size_t len = in.size();
+    char* dst = out.data();
+
+    if (_carry_size > 0) {
+        const std::size_t needed = 3 - _carry_size;
+        if (len < needed) {
+            memcpy(_carry + _carry_size, data, len);
+            _carry_size += len;
+            return 0;
+        }
+
+        uint8_t group[3];
+        memcpy(group, _carry, _carry_size);
+        memcpy(group + _carry_size, data, needed);
+        dst += Base64::encode_to(group, 3, dst);
+
+        data += needed;
+        len -= needed;
+        _carry_size = 0;
+    }
+
+    const std::size_t bulk = (len / 3) * 3;
+    dst += Base64::encode_to(data, bulk, dst);
+
+    _carry_size = len - bulk;
+    memcpy(_carry, data + bulk, _carry_size);
+
+    return dst - out.data();
+}
+
+std::size_t Base64Encoder::finish(std::span<char> out) {
+    if (_carry_size == 0) {
+        return 0;
+    }
+
+    bioassert(out.size() >= 4, "Base64Encoder output of {} characters is too small for the padding",
+              out.size());
+
+    const std::size_t written = Base64::encode_to(_carry, _carry_size, out.data());
+    _carry_size = 0;
+
+    return written;
+}
+
+bool Base64Decoder::update(std::span<const char> in, std::span<uint8_t> out, std::size_t& written) {
+    written = 0;
+
+    if (_error) {
+        return false;
+    }
+
+    bioassert(out.size() >= max_output_size(in.size()),
+              "Base64Decoder output of {} bytes is too small for {} characters",
+              out.size(), in.size());
+
+    const char* data = in.data();
+    std::size_t len = in.size();
+    uint8_t* dst = out.data();
+
+    if (_carry_size > 0) {
+        const std::size_t needed = 4 - _carry_size;
+        if (len < needed) {
+            memcpy(_carry + _carry_size, data, len);
+            _carry_size += len;
+            return true;
+        }
+
+        char quad[4];
+        memcpy(quad, _carry, _carry_size);
+        memcpy(quad + _carry_size, data, needed);
+
+        std::size_t quad_written = 0;
+        if (!decode_quads(quad, 4, dst, quad_written)) {
+            return false;
+        }
+        dst += quad_written;
+
+        data += needed;
+        len -= needed;
+        _carry_size = 0;
+    }
+
+    const std::size_t bulk = (len / 4) * 4;
+    if (bulk > 0) {
+        std::size_t bulk_written = 0;
+        if (!decode_quads(data, bulk, dst, bulk_written)) {
+            return false;
+        }
+        dst += bulk_written;
+    }
+
+    _carry_size = len - bulk;
+    memcpy(_carry, data + bulk, _carry_size);
+
+    // Nothing can follow the padding
+    if (_padded && _carry_size > 0) {
+        _error = true;
+        return false;
+    }
+
+    written = dst - out.data();
+    return true;
+}
+
+bool Base64Decoder::finish() {
+    const bool complete = !_error && _carry_size == 0;
+    reset();
+    return complete;
+}
+
+void Base64Decoder::reset() {
+    _carry_size = 0;
+    _padded = false;
+    _error = false;
+}
+
+bool Base64Decoder::decode_quads(const char* data, std::size_t len, uint8_t* out, std::size_t& written) {
+    if (_padded || !Base64::decode_to(data, len, out, written)) {
+        _error = true;
+        return false;
+    }
+
+    _padded = data[len - 1] == '=';
+    return true;
+}
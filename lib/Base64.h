@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -47,45 +48,37 @@ public:
         return (input_len / 4) * 3;
     }
 
-    // High-performance encoder - processes 3 bytes at a time with 64-bit operations
+    // Writes exactly encode_size(len) characters to out, returns their number.
+    // The bulk of the input goes through the widest SIMD kernel supported by
+    // the CPU (AVX-512 VBMI, AVX2 or SSSE3), selected once at runtime.
+    // TURING_BASE64_ISA=scalar|ssse3|avx2|avx512 restricts the selection.
+    static std::size_t encode_to(const uint8_t* data, std::size_t len, char* out) noexcept;
+
+    // Decodes len characters, a multiple of 4, into out that must have room
+    // for decode_max_size(len) bytes. Validation is done in the same pass.
+    // Returns false on invalid input, the content of out is then unspecified.
+    static bool decode_to(const char* data, std::size_t len, uint8_t* out, std::size_t& out_len) noexcept;
+
+    // Name of the kernels in use
+    static const char* kernel_name() noexcept;
+
+    // Same as encode_to and decode_to, splitting inputs of several megabytes
+    // across threads at 3-byte/4-character boundaries. The calling thread
+    // encodes one of the chunks. thread_count = 0 uses all the cores.
+    static std::size_t encode_parallel(const uint8_t* data, std::size_t len, char* out,
+                                       std::size_t thread_count = 0);
+    static bool decode_parallel(const char* data, std::size_t len, uint8_t* out, std::size_t& out_len,
+                                std::size_t thread_count = 0);
+
+    // Appends the encoding of data to result
     static void encode(const uint8_t* data, const std::size_t len, std::string& result) {
         if (len == 0) {
             return;
         }
 
-        result.reserve(encode_size(len));
-
-        const uint8_t* end = data + len;
-        const uint8_t* chunk_end = data + (len / 3) * 3; // Process full 3-byte chunks
-
-        // Process 3-byte chunks using 64-bit operations
-        while (data < chunk_end) {
-            // Load 3 bytes into a 32-bit value (big-endian style)
-            const uint32_t chunk = (static_cast<uint32_t>(data[0]) << 16) |
-                           (static_cast<uint32_t>(data[1]) << 8) |
-                           static_cast<uint32_t>(data[2]);
-
-            // Extract 4 x 6-bit values and encode
-            result += encode_table[(chunk >> 18) & 0x3F];
-            result += encode_table[(chunk >> 12) & 0x3F];
-            result += encode_table[(chunk >> 6) & 0x3F];
-            result += encode_table[chunk & 0x3F];
-
-            data += 3;
-        }
-
-        // Handle remaining 1-2 bytes
-        if (data < end) {
-            uint32_t chunk = static_cast<uint32_t>(data[0]) << 16;
-            if (data + 1 < end) {
-                chunk |= static_cast<uint32_t>(data[1]) << 8;
-            }
-
-            result += encode_table[(chunk >> 18) & 0x3F];
-            result += encode_table[(chunk >> 12) & 0x3F];
-            result += (data + 1 < end) ? encode_table[(chunk >> 6) & 0x3F] : '=';
-            result += '=';
-        }
+        const std::size_t offset = result.size();
+        result.resize(offset + encode_size(len));
+        encode_to(data, len, result.data() + offset);
     }
 
     // Convenience overload for std::vector
@@ -98,66 +91,29 @@ public:
         return encode(reinterpret_cast<const uint8_t*>(data.data()), data.size(), result);
     }
 
-    // High-performance decoder with validation
-    static void decode(const char* data, const std::size_t len, std::vector<uint8_t>& result) {
+    // Appends the decoded bytes to result.
+    // Returns false and leaves result unchanged if data is not valid base64
+    static bool decode(const char* data, const std::size_t len, std::vector<uint8_t>& result) {
         if (len == 0) {
-            return;
+            return true;
         }
+
         if (len % 4 != 0) {
-            return; // Invalid base64 length
+            return false; // Invalid base64 length
         }
 
-        result.reserve(decode_max_size(len));
-
-        const char* end = data + len;
-
-        // Process 4-character chunks
-        while (data < end) {
-            // Load and validate 4 characters
-            const uint8_t a = decode_table[static_cast<uint8_t>(data[0])];
-            const uint8_t b = decode_table[static_cast<uint8_t>(data[1])];
-            const uint8_t c = decode_table[static_cast<uint8_t>(data[2])];
-            const uint8_t d = decode_table[static_cast<uint8_t>(data[3])];
-
-            // Check for invalid characters (255 = invalid, 254 = padding)
-            if (a == 255 || b == 255) {
-                return; // Invalid chars in required positions
-            }
-            if (a == 254 || b == 254) {
-                return; // Padding not allowed in first 2 positions
-            }
-            if (c == 255 || d == 255) {
-                return; // Invalid chars anywhere
-            }
-            if (c == 254 && d != 254) {
-                return; // If 3rd is padding, 4th must be too
-            }
-            if (d == 254 && c != 254 && data < end - 4) {
-                return; // Padding only allowed at very end
-            }
-
-            // Combine 4 x 6-bit values into 24-bit chunk
-            const uint32_t chunk = (static_cast<uint32_t>(a) << 18) |
-                             (static_cast<uint32_t>(b) << 12) |
-                             (static_cast<uint32_t>(c & 0x3F) << 6) |
-                             static_cast<uint32_t>(d & 0x3F);
-
-            // Extract bytes based on padding
-            result.push_back((chunk >> 16) & 0xFF);
+        const std::size_t offset = result.size();
+        result.resize(offset + decode_max_size(len));
 
-            if (c != 254) { // Not padding
-                result.push_back((chunk >> 8) & 0xFF);
-                if (d != 254) { // Not padding
-                    result.push_back(chunk & 0xFF);
-                }
-            }
+        std::size_t written = 0;
+        const bool valid = decode_to(data, len, result.data() + offset, written);
+        result.resize(valid ? offset + written : offset);
 
-            data += 4;
-        }
+        return valid;
     }
 
     // Convenience overload for std::string
-    static void decode(const std::string& data, std::vector<uint8_t>& result) {
+    static bool decode(const std::string& data, std::vector<uint8_t>& result) {
         return decode(data.data(), data.size(), result);
     }
 
@@ -192,3 +148,54 @@ public:
         return true;
     }
 };
+
+// Incremental encoding of a stream given in chunks of any size.
+// The 1-2 bytes that do not fill a group of 3 are carried to the next call.
+class Base64Encoder {
+public:
+    // Maximum number of characters written by update for len input bytes
+    static constexpr std::size_t max_output_size(const std::size_t len) noexcept {
+        return ((len + 2) / 3) * 4;
+    }
+
+    // Encodes the complete groups of 3 bytes, returns the number of characters
+    // written to out, which must hold max_output_size(in.size()) characters
+    std::size_t update(std::span<const uint8_t> in, std::span<char> out);
+
+    // Writes the carried bytes with padding, at most 4 characters.
+    // The encoder can then be reused for a new stream.
+    std::size_t finish(std::span<char> out);
+
+private:
+    uint8_t _carry[2] {0, 0};
+    std::size_t _carry_size {0};
+};
+
+// Incremental decoding of a stream given in chunks of any size.
+// The 1-3 characters that do not fill a quad are carried to the next call.
+class Base64Decoder {
+public:
+    // Maximum number of bytes written by update for len input characters
+    static constexpr std::size_t max_output_size(const std::size_t len) noexcept {
+        return ((len + 3) / 4) * 3;
+    }
+
+    // Decodes the complete quads, out must hold max_output_size(in.size())
+    // bytes. Returns false on invalid input, including data after padding.
+    // The decoder then stays in error until reset.
+    bool update(std::span<const char> in, std::span<uint8_t> out, std::size_t& written);
+
+    // Returns false if the stream ended in the middle of a quad or in error.
+    // The decoder is reset for a new stream.
+    bool finish();
+
+    void reset();
+
+private:
+    char _carry[3] {0, 0, 0};
+    std::size_t _carry_size {0};
+    bool _padded {false};
+    bool _error {false};
+
+    bool decode_quads(const char* data, std::size_t len, uint8_t* out, std::size_t& written);
+};
@@ -0,0 +1,369 @@
+#include "BufferedFileWriter.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+namespace {
+
+bool writevAll(int fd, iovec* iov, int count) {
+    while (count > 0) {
+        const ssize_t res = ::writev(fd, iov, count);
+        if (res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        // Skip what was written, resume in the middle of a partial vector
+        size_t done = res;
+        while (count > 0 && done >= iov->iov_len) {
+            done -= iov->iov_len;
+            iov++;
+            count--;
+        }
+
+        if (count > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + done;
+            iov->iov_len -= done;
+        }
+    }
+
+    return true;
+}
+
+// fdatasync where available. macOS only has fsync, which leaves the data in
+// the drive cache, and F_FULLFSYNC, which flushes it
+bool syncData(int fd) {
+#ifdef __APPLE__
+    return fcntl(fd, F_FULLFSYNC) == 0 || fsync(fd) == 0;
+#else
+    return fdatasync(fd) == 0;
+#endif
+}
+
+// Reserves size bytes on disk. Only a full disk is an error, the file
+// systems that do not support preallocation are written to normally
+bool preallocate(int fd, uint64_t size) {
+#ifdef __APPLE__
+    // Contiguous blocks if possible. The file size is left unchanged
+    fstore_t store {F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t)size, 0};
+    if (fcntl(fd, F_PREALLOCATE, &store) == 0) {
+        return true;
+    }
+
+    store.fst_flags = F_ALLOCATEALL;
+    return fcntl(fd, F_PREALLOCATE, &store) == 0 || errno != ENOSPC;
+#else
+    return posix_fallocate(fd, 0, size) != ENOSPC;
+#endif
+}
+
+// Makes a rename in the directory durable
+bool syncParentDirectory(const std::filesystem::path& path) {
+    const std::filesystem::path parent = path.has_parent_path() ? path.parent_path() : ".";
+    const int fd = ::open(parent.string().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    const bool synced = fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+}
+
+}
+
+BufferedFileWriter::~BufferedFileWriter() {
+    if (_fd < 0) {
+        return;
+    }
+
+    if (_options.atomic) {
+        discard();
+    } else {
+        close();
+    }
+}
+
+BufferedFileWriter::BufferedFileWriter(BufferedFileWriter&& other) noexcept
+    : _fd(std::exchange(other._fd, -1)),
+    _path(std::move(other._path)),
+    _tempPath(std::move(other._tempPath)),
+    _options(other._options),
+    _buffer(std::move(other._buffer)),
+    _used(std::exchange(other._used, 0)),
+    _flushedBytes(std::exchange(other._flushedBytes, 0)),
+    _unsyncedBytes(std::exchange(other._unsyncedBytes, 0)),
+    _direct(other._direct),
+    _failed(other._failed)
+{
+}
+
+BufferedFileWriter& BufferedFileWriter::operator=(BufferedFileWriter&& other) noexcept {
+    if (this == &other) {
+        return *this;
+    }
+
+    if (_fd >= 0) {
+        if (_options.atomic) {
+            discard();
+        } else {
+            close();
+        }
+    }
+
+    _fd = std::exchange(other._fd, -1);
+    _path = std::move(other._path);
+    _tempPath = std::move(other._tempPath);
+    _options = other._options;
+    _buffer = std::move(other._buffer);
+    _used = std::exchange(other._used, 0);
+    _flushedBytes = std::exchange(other._flushedBytes, 0);
+    _unsyncedBytes = std::exchange(other._unsyncedBytes, 0);
+    _direct = other._direct;
+    _failed = other._failed;
+
+    return *this;
+}
+
+std::optional<BufferedFileWriter> BufferedFileWriter::open(const Path& path, Options options) {
+    BufferedFileWriter writer;
+    writer._path = path;
+    writer._options = options;
+
+    if (options.atomic) {
+        std::string tempPath = path.string() + ".tmp.XXXXXX";
+        writer._fd = mkostemp(tempPath.data(), O_CLOEXEC);
+        if (writer._fd < 0) {
+            return std::nullopt;
+        }
+
+        writer._tempPath = tempPath;
+        fchmod(writer._fd, options.permissions);
+    } else {
+        writer._fd = ::open(path.string().c_str(),
+                            O_WRONLY | O_TRUNC | O_CREAT | O_CLOEXEC,
+                            options.permissions);
+        if (writer._fd < 0) {
+            return std::nullopt;
+        }
+    }
+
+    // Whole pages, so that full buffers are written at aligned offsets
+    auto buffer = AlignedBuffer::allocate(options.bufferSize, BUFFER_ALIGNMENT);
+    if (!buffer) {
+        writer.discard();
+        return std::nullopt;
+    }
+
+    writer._buffer = std::move(*buffer);
+    writer._direct = options.directIO && DirectIO::enable(writer._fd, BUFFER_ALIGNMENT);
+
+    if (options.preallocate > 0) {
+        if (!preallocate(writer._fd, options.preallocate)) {
+            writer.discard();
+            return std::nullopt;
+        }
+    }
+
+    return writer;
+}
+
+bool BufferedFileWriter::write(const void* data, size_t size) {
+    if (_failed || _fd < 0) {
+        return false;
+    }
+
+    const char* src = static_cast<const char*>(data);
+    const size_t bufferSize = _buffer.size();
+
+    if (size <= bufferSize - _used) {
+        [[likely]]
+        memcpy(_buffer.data() + _used, src, size);
+        _used += size;
+        return true;
+    }
+
+    if (size >= bufferSize && !_direct) {
+        return writeOut(src, size);
+    }
+
+    // Completes the buffer, so that the file is written in full buffers.
+    // Direct I/O writes all the data from the aligned buffer
+    while (size > 0) {
+        const size_t chunk = std::min(size, bufferSize - _used);
+        memcpy(_buffer.data() + _used, src, chunk);
+        _used += chunk;
+        src += chunk;
+        size -= chunk;
+
+        if (_used == bufferSize && !writeOut(nullptr, 0)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool BufferedFileWriter::writeOut(const char* extra, size_t extraSize) {
+    if (_direct) {
+        // Aligned data only, never extra
+        if (!DirectIO::writeAt(_fd, _buffer.data(), _used, _flushedBytes)) {
+            _failed = true;
+            return false;
+        }
+    } else {
+        iovec iov[2] = {
+            {_buffer.data(), _used},
+            {const_cast<char*>(extra), extraSize},
+        };
+
+        if (!writevAll(_fd, iov, extraSize > 0 ? 2 : 1)) {
+            _failed = true;
+            return false;
+        }
+    }
+
+    const size_t written = _used + extraSize;
+    _flushedBytes += written;
+    _unsyncedBytes += written;
+    _used = 0;
+
+    if (_options.durability == Durability::Periodic && _unsyncedBytes >= _options.syncInterval) {
+        if (!syncData(_fd)) {
+            _failed = true;
+            return false;
+        }
+        _unsyncedBytes = 0;
+    }
+
+    return true;
+}
+
+bool BufferedFileWriter::flush() {
+    if (_failed || _fd < 0) {
+        return false;
+    }
+
+    if (_used == 0) {
+        return true;
+    }
+
+    return _direct ? flushDirect() : writeOut(nullptr, 0);
+}
+
+bool BufferedFileWriter::flushDirect() {
+    const size_t tail = _used % BUFFER_ALIGNMENT;
+    const size_t aligned = _used - tail;
+
+    if (aligned > 0) {
+        _used = aligned;
+        if (!writeOut(nullptr, 0)) {
+            return false;
+        }
+
+        memmove(_buffer.data(), _buffer.data() + aligned, tail);
+        _used = tail;
+    }
+
+    if (tail == 0) {
+        return true;
+    }
+
+    // The tail stays buffered at the front, the next writeOut rewrites
+    // its block completed with the data that follows
+    memset(_buffer.data() + tail, 0, BUFFER_ALIGNMENT - tail);
+    if (!DirectIO::writeAt(_fd, _buffer.data(), BUFFER_ALIGNMENT, _flushedBytes)) {
+        _failed = true;
+        return false;
+    }
+
+    // Cuts the padding off, unless it lies within the preallocated space
+    const uint64_t fileSize = std::max(_flushedBytes + tail, _options.preallocate);
+    if (_flushedBytes + BUFFER_ALIGNMENT > fileSize && ftruncate(_fd, fileSize) != 0) {
+        _failed = true;
+        return false;
+    }
+
+    return true;
+}
+
+bool BufferedFileWriter::sync() {
+    if (!flush()) {
+        return false;
+    }
+
+    if (!syncData(_fd)) {
+        _failed = true;
+        return false;
+    }
+
+    _unsyncedBytes = 0;
+    return true;
+}
+
+bool BufferedFileWriter::close() {
+    if (_fd < 0) {
+        return false;
+    }
+
+    bool success = flush();
+
+    if (success && _options.preallocate > bytesWritten()) {
+        success = ftruncate(_fd, bytesWritten()) == 0;
+    }
+
+    // The data of an atomic file must be on disk before the rename,
+    // otherwise a crash could leave an empty file at the destination
+    if (success && (_options.durability != Durability::None || _options.atomic)) {
+        success = syncData(_fd);
+    }
+
+    success = ::close(_fd) == 0 && success;
+    _fd = -1;
+
+    if (_options.atomic) {
+        if (success) {
+            success = rename(_tempPath.c_str(), _path.c_str()) == 0;
+        }
+
+        if (!success) {
+            unlink(_tempPath.c_str());
+        } else if (_options.durability != Durability::None) {
+            success = syncParentDirectory(_path);
+        }
+    }
+
+    _failed = _failed || !success;
+    release();
+
+    return success;
+}
+
+void BufferedFileWriter::discard() {
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+
+    if (_options.atomic && !_tempPath.empty()) {
+        unlink(_tempPath.c_str());
+    }
+
+    release();
+}
+
+void BufferedFileWriter::release() {
+    _buffer = AlignedBuffer();
+    _used = 0;
+    _tempPath.clear();
+}
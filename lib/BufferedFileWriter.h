@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <filesystem>
+#include <optional>
+#include <string_view>
+
+#include "DirectIO.h"
+
+enum class FileDurability {
+    // Data reaches the disk when the kernel writes it back
+    None,
+
+    // fdatasync before close, F_FULLFSYNC on macOS
+    SyncOnClose,
+
+    // fdatasync every syncInterval bytes and before close
+    Periodic,
+};
+
+struct BufferedFileWriterOptions {
+    size_t bufferSize {1024 * 1024};
+
+    // Bytes reserved on disk at open with posix_fallocate (F_PREALLOCATE
+    // on macOS), the file is truncated to the bytes written on close
+    uint64_t preallocate {0};
+
+    FileDurability durability {FileDurability::None};
+    uint64_t syncInterval {64ull * 1024 * 1024};
+
+    // Writes to a temporary file next to the destination, renamed over it
+    // on close. Readers see either the previous file or the complete new one
+    bool atomic {false};
+
+    // Bypasses the page cache with O_DIRECT, for large files that are not
+    // read back soon. Falls back to buffered writes where unsupported
+    bool directIO {false};
+
+    mode_t permissions {0600};
+};
+
+// Sequential file writer accumulating the data in a page-aligned buffer.
+// Writes larger than the buffer go straight to the file, batched with the
+// buffered data in a single writev. Short writes and EINTR are retried.
+//
+// With direct I/O, all the data goes through the buffer, written in full
+// buffers at aligned offsets. Flushing a partial buffer writes its aligned
+// part, and the unaligned tail padded with zeros before truncating the file
+// to its size. The tail stays buffered and is rewritten with the data that
+// follows it.
+//
+// After an error, all the calls fail. close must be called to commit the
+// file: destroying an atomic writer that was not closed removes the
+// temporary file, the destination is left untouched.
+class BufferedFileWriter {
+public:
+    using Path = std::filesystem::path;
+    using Durability = FileDurability;
+    using Options = BufferedFileWriterOptions;
+
+    static constexpr size_t BUFFER_ALIGNMENT = AlignedBuffer::DEFAULT_ALIGNMENT;
+
+    ~BufferedFileWriter();
+
+    BufferedFileWriter(const BufferedFileWriter&) = delete;
+    BufferedFileWriter(BufferedFileWriter&& other) noexcept;
+    BufferedFileWriter& operator=(const BufferedFileWriter&) = delete;
+    BufferedFileWriter& operator=(BufferedFileWriter&& other) noexcept;
+
+    // Creates or truncates path, or a temporary file in atomic mode
+    [[nodiscard]] static std::optional<BufferedFileWriter> open(const Path& path,
+                                                                Options options = {});
+
+    bool write(const void* data, size_t size);
+    bool write(std::string_view str) { return write(str.data(), str.size()); }
+
+    // Writes the buffered data to the file
+    bool flush();
+
+    // Flushes and waits for the data to be on disk
+    bool sync();
+
+    // Flushes, syncs according to the durability, and renames the file to
+    // its destination in atomic mode. Returns false if anything failed
+    bool close();
+
+    // Closes without committing, removes the temporary file in atomic mode
+    void discard();
+
+    // Bytes passed to write, buffered ones included
+    uint64_t bytesWritten() const { return _flushedBytes + _used; }
+    bool isOpen() const { return _fd >= 0; }
+    bool hasFailed() const { return _failed; }
+    bool isDirect() const { return _fd >= 0 && DirectIO::isEnabled(_fd); }
+    const Path& path() const { return _path; }
+
+private:
+    int _fd {-1};
+    Path _path;
+    Path _tempPath;
+    Options _options;
+    AlignedBuffer _buffer;
+    size_t _used {0};
+    uint64_t _flushedBytes {0};
+    uint64_t _unsyncedBytes {0};
+    bool _direct {false};
+    bool _failed {false};
+
+    BufferedFileWriter() = default;
+
+    bool writeOut(const char* extra, size_t extraSize);
+    bool flushDirect();
+    void release();
+};
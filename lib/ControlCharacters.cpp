@@ -0,0 +1,218 @@
+#include "ControlCharacters.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Characters that may need escaping: below 0x20, quote and backslash
+bool isSpecial(uint8_t c) {
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+// Position of the first special character in [pos, size), or size
+size_t findSpecial(const char* data, size_t pos, size_t size) {
+#ifdef __SSE2__
+    const __m128i controlMax = _mm_set1_epi8(0x1F);
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+
+    while (pos + 16 <= size) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+
+        // Unsigned c <= 0x1F if and only if max(c, 0x1F) == 0x1F
+        const __m128i control = _mm_cmpeq_epi8(_mm_max_epu8(block, controlMax), controlMax);
+        const __m128i match = _mm_or_si128(control,
+                                           _mm_or_si128(_mm_cmpeq_epi8(block, quote),
+                                                        _mm_cmpeq_epi8(block, backslash)));
+
+        const uint32_t mask = _mm_movemask_epi8(match);
+        if (mask) {
+            return pos + __builtin_ctz(mask);
+        }
+
+        pos += 16;
+    }
+#endif
+
+    while (pos < size && !isSpecial(data[pos])) {
+        pos++;
+    }
+
+    return pos;
+}
+
+// Escape sequence of c, or nullptr if c is left as is
+const char* getShortEscape(char c, ControlCharactersEscaper::Mode mode) {
+    switch (c) {
+        case '\b': return "\\b";
+        case '\t': return "\\t";
+        case '\n': return "\\n";
+        case '\f': return "\\f";
+        case '\r': return "\\r";
+        case '"': return "\\\"";
+        case '\\': return "\\\\";
+        case '\a': return mode == ControlCharactersEscaper::Mode::C ? "\\a" : nullptr;
+        case '\v': return mode == ControlCharactersEscaper::Mode::C ? "\\v" : nullptr;
+        default: return nullptr;
+    }
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+
+    return -1;
+}
+
+bool parseHex4(const char* data, uint32_t& value) {
+    value = 0;
+    for (size_t i = 0; i < 4; i++) {
+        const int digit = hexValue(data[i]);
+        if (digit < 0) {
+            return false;
+        }
+        value = (value << 4) | digit;
+    }
+
+    return true;
+}
+
+void appendUTF8(uint32_t codePoint, std::string& result) {
+    if (codePoint < 0x80) {
+        result += (char)codePoint;
+    } else if (codePoint < 0x800) {
+        result += (char)(0xC0 | (codePoint >> 6));
+        result += (char)(0x80 | (codePoint & 0x3F));
+    } else if (codePoint < 0x10000) {
+        result += (char)(0xE0 | (codePoint >> 12));
+        result += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+        result += (char)(0x80 | (codePoint & 0x3F));
+    } else {
+        result += (char)(0xF0 | (codePoint >> 18));
+        result += (char)(0x80 | ((codePoint >> 12) & 0x3F));
+        result += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+        result += (char)(0x80 | (codePoint & 0x3F));
+    }
+}
+
+// Parses the \uXXXX escape at pos, and the low surrogate that must follow
+// a high surrogate. Returns the position after it, or 0 if it is invalid
+size_t parseUnicodeEscape(std::string_view src, size_t pos, std::string& result) {
+    uint32_t codePoint = 0;
+    if (pos + 6 > src.size() || !parseHex4(src.data() + pos + 2, codePoint)) {
+        return 0;
+    }
+    pos += 6;
+
+    if (codePoint >= 0xDC00 && codePoint <= 0xDFFF) {
+        return 0;
+    }
+
+    if (codePoint >= 0xD800 && codePoint <= 0xDBFF) {
+        uint32_t low = 0;
+        if (pos + 6 > src.size()
+            || src[pos] != '\\' || src[pos + 1] != 'u'
+            || !parseHex4(src.data() + pos + 2, low)
+            || low < 0xDC00 || low > 0xDFFF) {
+            return 0;
+        }
+        pos += 6;
+
+        codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+    }
+
+    appendUTF8(codePoint, result);
+    return pos;
+}
+
+}
+
+void ControlCharactersEscaper::escape(std::string_view src, std::string& result, Mode mode) {
+    static constexpr char HEX_DIGITS[] = "0123456789abcdef";
+
+    result.clear();
+    result.reserve(src.size());
+
+    const char* data = src.data();
+    const size_t size = src.size();
+    size_t start = 0;
+
+    for (;;) {
+        const size_t pos = findSpecial(data, start, size);
+        result.append(data + start, pos - start);
+        if (pos == size) {
+            break;
+        }
+
+        const char c = data[pos];
+        if (const char* escaped = getShortEscape(c, mode)) {
+            result.append(escaped, 2);
+        } else if (mode == Mode::JSON) {
+            const char unicode[6] = {'\\', 'u', '0', '0',
+                                     HEX_DIGITS[(uint8_t)c >> 4],
+                                     HEX_DIGITS[(uint8_t)c & 0xF]};
+            result.append(unicode, sizeof(unicode));
+        } else {
+            result += c;
+        }
+
+        start = pos + 1;
+    }
+}
+
+bool ControlCharactersEscaper::unescape(std::string_view src, std::string& result) {
+    result.clear();
+    result.reserve(src.size());
+
+    const char* data = src.data();
+    const size_t size = src.size();
+    size_t start = 0;
+
+    for (;;) {
+        const void* found = memchr(data + start, '\\', size - start);
+        const size_t pos = found ? static_cast<const char*>(found) - data : size;
+        result.append(data + start, pos - start);
+        if (pos == size) {
+            return true;
+        }
+
+        if (pos + 1 == size) {
+            return false;
+        }
+
+        start = pos + 2;
+        switch (data[pos + 1]) {
+            case 'a': result += '\a'; break;
+            case 'b': result += '\b'; break;
+            case 't': result += '\t'; break;
+            case 'n': result += '\n'; break;
+            case 'v': result += '\v'; break;
+            case 'f': result += '\f'; break;
+            case 'r': result += '\r'; break;
+            case '"': result += '"'; break;
+            case '\\': result += '\\'; break;
+            case '/': result += '/'; break;
+            case 'u': {
+                start = parseUnicodeEscape(src, pos, result);
+                if (start == 0) {
+                    return false;
+                }
+                break;
+            }
+            default: {
+                return false;
+            }
+        }
+    }
+}
@@ -1,54 +1,29 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 
+// Escaping of the quotes, backslashes and control characters of a string.
+//
+// Mode::C escapes \a \b \t \n \v \f \r \" and \\ and leaves the other bytes
+// as they are. Mode::JSON produces a valid JSON string body: \b \t \n \f \r
+// \" and \\, and \u00XX for the other bytes below 0x20.
+//
+// Clean runs of characters are found 16 bytes at a time and copied in bulk,
+// so strings that need no escaping cost little more than a copy.
 class ControlCharactersEscaper {
 public:
-    static void escape(std::string_view src, std::string& result) {
-        result.clear();
-        for (const char c : src) {
-            switch (c) {
-                case '\a': {
-                    result += "\\a";
-                    break;
-                }
-                case '\x08': {
-                    result += "\\b";
-                    break;
-                }
-                case '\t': {
-                    result += "\\t";
-                    break;
-                }
-                case '\n': {
-                    result += "\\n";
-                    break;
-                }
-                case '\v': {
-                    result += "\\v";
-                    break;
-                }
-                case '\f': {
-                    result += "\\f";
-                    break;
-                }
-                case '\r': {
-                    result += "\\r";
-                    break;
-                }
-                case '\"': {
-                    result += "\\\"";
-                    break;
-                }
-                case '\\': {
-                    result += "\\\\";
-                    break;
-                }
-                default: {
-                    result += c;
-                    break;
-                }
-            }
-        }
-    }
+    enum class Mode {
+        C,
+        JSON,
+    };
+
+    ControlCharactersEscaper() = delete;
+
+    static void escape(std::string_view src, std::string& result, Mode mode = Mode::C);
+
+    // Reverses escape in both modes, \/ and \uXXXX escapes included (encoded
+    // in UTF-8, surrogate pairs combined). Returns false if an escape
+    // sequence is invalid, result is then unspecified
+    static bool unescape(std::string_view src, std::string& result);
 };
@@ -0,0 +1,100 @@
+#include "DirectFileReader.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <utility>
+
+DirectFileReader::~DirectFileReader() {
+    close();
+}
+
+DirectFileReader::DirectFileReader(DirectFileReader&& other) noexcept
+    : _fd(std::exchange(other._fd, -1)),
+    _buffer(std::move(other._buffer)),
+    _fileSize(std::exchange(other._fileSize, 0)),
+    _offset(std::exchange(other._offset, 0)),
+    _failed(other._failed)
+{
+}
+
+DirectFileReader& DirectFileReader::operator=(DirectFileReader&& other) noexcept {
+    if (this == &other) {
+        return *this;
+    }
+
+    close();
+
+    _fd = std::exchange(other._fd, -1);
+    _buffer = std::move(other._buffer);
+    _fileSize = std::exchange(other._fileSize, 0);
+    _offset = std::exchange(other._offset, 0);
+    _failed = other._failed;
+
+    return *this;
+}
+
+std::optional<DirectFileReader> DirectFileReader::open(const Path& path, Options options) {
+    DirectFileReader reader;
+    reader._fd = ::open(path.string().c_str(), O_RDONLY | O_CLOEXEC);
+    if (reader._fd < 0) {
+        return std::nullopt;
+    }
+
+    struct stat statBuf;
+    if (fstat(reader._fd, &statBuf) != 0 || !S_ISREG(statBuf.st_mode)) {
+        return std::nullopt;
+    }
+
+    reader._fileSize = statBuf.st_size;
+
+    auto buffer = AlignedBuffer::allocate(options.bufferSize);
+    if (!buffer) {
+        return std::nullopt;
+    }
+
+    reader._buffer = std::move(*buffer);
+
+    if (!options.directIO || !DirectIO::enable(reader._fd)) {
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(reader._fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    }
+
+    return reader;
+}
+
+std::span<const char> DirectFileReader::read() {
+    if (_failed || _fd < 0 || isEnd()) {
+        return {};
+    }
+
+    // Full chunks keep the offset aligned, the last one is read whole
+    // and comes back short
+    const ssize_t bytesRead = DirectIO::readAt(_fd, _buffer.data(), _buffer.size(), _offset);
+    if (bytesRead <= 0) {
+        _failed = bytesRead < 0;
+        _offset = _fileSize;
+        return {};
+    }
+
+#ifdef POSIX_FADV_DONTNEED
+    if (!DirectIO::isEnabled(_fd)) {
+        // The chunk is copied out, its pages are of no further use
+        posix_fadvise(_fd, _offset, bytesRead, POSIX_FADV_DONTNEED);
+    }
+#endif
+
+    _offset += bytesRead;
+    return {_buffer.data(), static_cast<size_t>(bytesRead)};
+}
+
+void DirectFileReader::close() {
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+
+    _buffer = AlignedBuffer();
+}
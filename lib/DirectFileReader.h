@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <filesystem>
+#include <optional>
+#include <span>
+
+#include "DirectIO.h"
+
+struct DirectFileReaderOptions {
+    // Bytes per read, rounded up to the alignment
+    size_t bufferSize {4 * 1024 * 1024};
+
+    // Bypasses the page cache with O_DIRECT where supported
+    bool directIO {true};
+};
+
+// Sequential reader of large files read once, e.g. imports, in chunks of
+// bufferSize bytes read into an aligned buffer.
+//
+// With direct I/O the chunks come straight from the disk and the page cache
+// is untouched. Where direct I/O is unsupported, the file is read through
+// the cache with a sequential hint and each chunk is dropped from the cache
+// once read, so the cached data of other files is preserved either way.
+class DirectFileReader {
+public:
+    using Path = std::filesystem::path;
+    using Options = DirectFileReaderOptions;
+
+    DirectFileReader() = default;
+    ~DirectFileReader();
+
+    DirectFileReader(const DirectFileReader&) = delete;
+    DirectFileReader(DirectFileReader&& other) noexcept;
+    DirectFileReader& operator=(const DirectFileReader&) = delete;
+    DirectFileReader& operator=(DirectFileReader&& other) noexcept;
+
+    [[nodiscard]] static std::optional<DirectFileReader> open(const Path& path, Options options = {});
+
+    // Next chunk of the file, valid until the next call. Empty at the end
+    // of the file or after an error
+    std::span<const char> read();
+
+    uint64_t fileSize() const { return _fileSize; }
+    uint64_t offset() const { return _offset; }
+    bool isEnd() const { return _offset >= _fileSize; }
+    bool isDirect() const { return _fd >= 0 && DirectIO::isEnabled(_fd); }
+    bool hasFailed() const { return _failed; }
+
+    void close();
+
+private:
+    int _fd {-1};
+    AlignedBuffer _buffer;
+    uint64_t _fileSize {0};
+    uint64_t _offset {0};
+    bool _failed {false};
+};
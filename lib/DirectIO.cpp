@@ -0,0 +1,158 @@
+#include "DirectIO.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace {
+
+// A transfer rejected with EINVAL under O_DIRECT is misaligned for the
+// device, it is retried through the page cache
+bool fallBackToBuffered(int fd) {
+    return errno == EINVAL && DirectIO::isEnabled(fd) && DirectIO::disable(fd);
+}
+
+}
+
+std::optional<AlignedBuffer> AlignedBuffer::allocate(size_t size, size_t alignment) {
+    AlignedBuffer buffer;
+    buffer._size = DirectIO::alignUp(std::max<size_t>(size, 1), alignment);
+    buffer._data.reset(static_cast<char*>(aligned_alloc(alignment, buffer._size)));
+    if (!buffer._data) {
+        return std::nullopt;
+    }
+
+    return buffer;
+}
+
+size_t DirectIO::getAlignment(int fd) {
+#ifdef STATX_DIOALIGN
+    struct statx stx;
+    if (statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0
+        && (stx.stx_mask & STATX_DIOALIGN)) {
+        return std::max(stx.stx_dio_mem_align, stx.stx_dio_offset_align);
+    }
+#endif
+
+    return AlignedBuffer::DEFAULT_ALIGNMENT;
+}
+
+#ifdef O_DIRECT
+
+bool DirectIO::enable(int fd, size_t alignment) {
+    const size_t required = getAlignment(fd);
+    if (required == 0 || required > alignment) {
+        return false;
+    }
+
+    const int flags = fcntl(fd, F_GETFL);
+    if (flags < 0) {
+        return false;
+    }
+
+    // Fails with EINVAL on the file systems without direct I/O
+    return fcntl(fd, F_SETFL, flags | O_DIRECT) == 0;
+}
+
+bool DirectIO::disable(int fd) {
+    const int flags = fcntl(fd, F_GETFL);
+    if (flags < 0) {
+        return false;
+    }
+
+    return fcntl(fd, F_SETFL, flags & ~O_DIRECT) == 0;
+}
+
+bool DirectIO::isEnabled(int fd) {
+    const int flags = fcntl(fd, F_GETFL);
+    return flags >= 0 && (flags & O_DIRECT);
+}
+
+#elif defined(F_NOCACHE)
+
+// macOS has no O_DIRECT, F_NOCACHE bypasses the unified buffer cache
+// and has no alignment requirement
+bool DirectIO::enable(int fd, size_t) {
+    return fcntl(fd, F_NOCACHE, 1) == 0;
+}
+
+bool DirectIO::disable(int fd) {
+    return fcntl(fd, F_NOCACHE, 0) == 0;
+}
+
+bool DirectIO::isEnabled(int fd) {
+#ifdef F_GETNOCACHE
+    return fcntl(fd, F_GETNOCACHE) > 0;
+#else
+    (void)fd;
+    return false;
+#endif
+}
+
+#else
+
+bool DirectIO::enable(int, size_t) {
+    return false;
+}
+
+bool DirectIO::disable(int) {
+    return true;
+}
+
+bool DirectIO::isEnabled(int) {
+    return false;
+}
+
+#endif
+
+ssize_t DirectIO::readAt(int fd, void* buffer, size_t size, uint64_t offset) {
+    char* dst = static_cast<char*>(buffer);
+    size_t done = 0;
+
+    while (done < size) {
+        const ssize_t res = pread(fd, dst + done, size - done, offset + done);
+        if (res < 0) {
+            if (errno == EINTR || fallBackToBuffered(fd)) {
+                continue;
+            }
+            return -1;
+        }
+
+        if (res == 0) {
+            break;
+        }
+
+        done += res;
+
+        // A direct read stops short only at the end of the file, reading
+        // on from an unaligned offset would be rejected
+        if (done < size && isEnabled(fd)) {
+            break;
+        }
+    }
+
+    return done;
+}
+
+bool DirectIO::writeAt(int fd, const void* buffer, size_t size, uint64_t offset) {
+    const char* src = static_cast<const char*>(buffer);
+
+    while (size > 0) {
+        const ssize_t res = pwrite(fd, src, size, offset);
+        if (res < 0) {
+            if (errno == EINTR || fallBackToBuffered(fd)) {
+                continue;
+            }
+            return false;
+        }
+
+        src += res;
+        size -= res;
+        offset += res;
+    }
+
+    return true;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include <memory>
+#include <optional>
+#include <span>
+
+// Heap buffer whose address and size are multiples of an alignment,
+// as direct I/O requires. Move-only, freed on destruction
+class AlignedBuffer {
+public:
+    static constexpr size_t DEFAULT_ALIGNMENT = 4096;
+
+    AlignedBuffer() = default;
+
+    // size is rounded up to a multiple of alignment, a power of 2
+    [[nodiscard]] static std::optional<AlignedBuffer> allocate(size_t size,
+                                                               size_t alignment = DEFAULT_ALIGNMENT);
+
+    char* data() { return _data.get(); }
+    const char* data() const { return _data.get(); }
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    std::span<char> span() { return {_data.get(), _size}; }
+
+private:
+    struct FreeDeleter {
+        void operator()(char* ptr) const { free(ptr); }
+    };
+
+    std::unique_ptr<char[], FreeDeleter> _data;
+    size_t _size {0};
+};
+
+// Direct I/O (O_DIRECT) transfers data between the disk and the buffers of
+// the process without going through the page cache. Reading or writing a
+// large file once this way leaves the cached data of other files in place.
+//
+// The buffer address, the file offset and the size of each transfer must be
+// multiples of the alignment of the file. The helpers below fall back to
+// buffered I/O on the file systems without direct I/O (e.g. tmpfs before
+// Linux 6.6) and when a transfer is rejected for its alignment, so that
+// callers only lose the cache bypass, never the data.
+// On macOS, which has no O_DIRECT, F_NOCACHE is used instead.
+class DirectIO {
+public:
+    DirectIO() = delete;
+
+    // Alignment required for direct I/O on fd, from statx when the kernel
+    // reports it, DEFAULT_ALIGNMENT otherwise. 0 if fd does not support it
+    static size_t getAlignment(int fd);
+
+    // Sets O_DIRECT on fd if its file system supports direct I/O with
+    // buffers and offsets aligned on alignment. Returns false otherwise,
+    // fd is then left for buffered I/O
+    static bool enable(int fd, size_t alignment = AlignedBuffer::DEFAULT_ALIGNMENT);
+
+    // Clears O_DIRECT, later transfers go through the page cache
+    static bool disable(int fd);
+
+    static bool isEnabled(int fd);
+
+    // Reads size bytes at offset, retrying EINTR and short reads, fewer
+    // only at the end of the file. With O_DIRECT, buffer, size and offset
+    // must be aligned; size may extend past the end of the file, which
+    // handles an unaligned tail. Returns the bytes read or -1
+    static ssize_t readAt(int fd, void* buffer, size_t size, uint64_t offset);
+
+    // Writes size bytes at offset, retrying EINTR and short writes. Same
+    // alignment as readAt: an unaligned tail is written padded, then the
+    // file is truncated to its size
+    static bool writeAt(int fd, const void* buffer, size_t size, uint64_t offset);
+
+    static constexpr size_t alignUp(size_t size, size_t alignment) {
+        return (size + alignment - 1) & ~(alignment - 1);
+    }
+
+    static constexpr size_t alignDown(size_t size, size_t alignment) {
+        return size & ~(alignment - 1);
+    }
+};
@@ -0,0 +1,325 @@
+#include "DirectoryScanner.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+// Directories waiting in the queue keep their fd open,
+// beyond this many they are scanned in place
+constexpr size_t MAX_QUEUED_DIRECTORIES = 256;
+
+#ifdef __linux__
+
+constexpr size_t DIRENT_BUFFER_SIZE = 64 * 1024;
+
+struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+#endif
+
+struct PendingDirectory {
+    int fd {-1};
+    std::string path;
+};
+
+DirectoryEntry::Type getType(mode_t mode) {
+    if (S_ISREG(mode)) {
+        return DirectoryEntry::Type::File;
+    } else if (S_ISDIR(mode)) {
+        return DirectoryEntry::Type::Directory;
+    } else if (S_ISLNK(mode)) {
+        return DirectoryEntry::Type::Symlink;
+    }
+    return DirectoryEntry::Type::Other;
+}
+
+#ifdef __linux__
+
+// Stats name in the directory dirFd, or dirFd itself if name is null
+bool statEntry(int dirFd, const char* name, DirectoryEntry& entry) {
+    struct statx stx;
+    const int flags = name ? AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT : AT_EMPTY_PATH;
+    if (statx(dirFd, name ? name : "", flags, STATX_TYPE | STATX_SIZE | STATX_MTIME, &stx) != 0) {
+        return false;
+    }
+
+    entry.type = getType(stx.stx_mode);
+    entry.size = stx.stx_size;
+    entry.mtime = stx.stx_mtime.tv_sec * 1000000000ll + stx.stx_mtime.tv_nsec;
+    return true;
+}
+
+#else
+
+bool statEntry(int dirFd, const char* name, DirectoryEntry& entry) {
+    struct stat st;
+    const int res = name ? fstatat(dirFd, name, &st, AT_SYMLINK_NOFOLLOW) : fstat(dirFd, &st);
+    if (res != 0) {
+        return false;
+    }
+
+#ifdef __APPLE__
+    const timespec& mtime = st.st_mtimespec;
+#else
+    const timespec& mtime = st.st_mtim;
+#endif
+
+    entry.type = getType(st.st_mode);
+    entry.size = st.st_size;
+    entry.mtime = mtime.tv_sec * 1000000000ll + mtime.tv_nsec;
+    return true;
+}
+
+#endif
+
+class Scan {
+public:
+    Scan(const DirectoryScannerOptions& options)
+        : _options(options)
+    {
+    }
+
+    void push(int fd, std::string path) {
+        {
+            std::lock_guard lock(_mutex);
+            _queue.push_back({fd, std::move(path)});
+        }
+        _cond.notify_one();
+    }
+
+    void run(std::vector<DirectoryEntry>& entries) {
+        for (;;) {
+            PendingDirectory dir;
+            {
+                std::unique_lock lock(_mutex);
+                _cond.wait(lock, [this] { return !_queue.empty() || _active == 0; });
+                if (_queue.empty()) {
+                    // No directory left and none being scanned
+                    _cond.notify_all();
+                    return;
+                }
+
+                dir = std::move(_queue.front());
+                _queue.pop_front();
+                _active++;
+            }
+
+            scanDirectory(dir.fd, dir.path, entries);
+
+            {
+                std::lock_guard lock(_mutex);
+                _active--;
+                if (_active == 0 && _queue.empty()) {
+                    _cond.notify_all();
+                }
+            }
+        }
+    }
+
+private:
+    const DirectoryScannerOptions& _options;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::deque<PendingDirectory> _queue;
+    size_t _active {0};
+
+    bool accepts(std::string_view name) const {
+        if (!_options.extensions.empty()) {
+            const size_t dot = name.rfind('.');
+            const std::string_view extension = (dot == std::string_view::npos || dot == 0)
+                                             ? std::string_view()
+                                             : name.substr(dot);
+
+            const auto& extensions = _options.extensions;
+            if (std::find(extensions.begin(), extensions.end(), extension) == extensions.end()) {
+                return false;
+            }
+        }
+
+        return !_options.nameFilter || _options.nameFilter(name);
+    }
+
+    bool isQueueFull() {
+        std::lock_guard lock(_mutex);
+        return _queue.size() >= MAX_QUEUED_DIRECTORIES;
+    }
+
+    // Scans the directory open at fd and closes it
+    void scanDirectory(int fd, const std::string& path, std::vector<DirectoryEntry>& entries) {
+#ifdef __linux__
+        // On the heap, directories scanned in place nest their buffers
+        std::unique_ptr<char[]> direntBuffer(new char[DIRENT_BUFFER_SIZE]);
+        char* buffer = direntBuffer.get();
+
+        for (;;) {
+            const long size = syscall(SYS_getdents64, fd, buffer, DIRENT_BUFFER_SIZE);
+            if (size <= 0) {
+                break;
+            }
+
+            for (long offset = 0; offset < size;) {
+                const LinuxDirent64* dirent = reinterpret_cast<const LinuxDirent64*>(buffer + offset);
+                offset += dirent->d_reclen;
+                scanEntry(fd, path, dirent->d_name, dirent->d_type, entries);
+            }
+        }
+
+        close(fd);
+#else
+        DIR* dir = fdopendir(fd);
+        if (!dir) {
+            close(fd);
+            return;
+        }
+
+        while (const dirent* entry = readdir(dir)) {
+            scanEntry(fd, path, entry->d_name, entry->d_type, entries);
+        }
+
+        // Closes fd as well
+        closedir(dir);
+#endif
+    }
+
+    void scanEntry(int fd, const std::string& path, const char* entryName,
+                   unsigned char type, std::vector<DirectoryEntry>& entries) {
+        const std::string_view name = entryName;
+        if (name == "." || name == "..") {
+            return;
+        }
+
+        DirectoryEntry entry;
+
+        // Some file systems do not fill d_type
+        const bool typeKnown = type != DT_UNKNOWN;
+        if (!typeKnown) {
+            if (!statEntry(fd, entryName, entry)) {
+                return;
+            }
+            type = entry.type == DirectoryEntry::Type::Directory ? DT_DIR : DT_REG;
+        }
+
+        std::string entryPath;
+        entryPath.reserve(path.size() + 1 + name.size());
+        entryPath.append(path);
+        entryPath += '/';
+        entryPath.append(name);
+
+        if (type == DT_DIR) {
+            scanSubdirectory(fd, entryName, std::move(entryPath), entries);
+            return;
+        }
+
+        if (!accepts(name)) {
+            return;
+        }
+
+        if (typeKnown && !statEntry(fd, entryName, entry)) {
+            // Removed meanwhile
+            return;
+        }
+
+        entry.path = std::move(entryPath);
+        entries.push_back(std::move(entry));
+    }
+
+    void scanSubdirectory(int parentFd, const char* name, std::string path,
+                          std::vector<DirectoryEntry>& entries) {
+        const bool traverse = _options.recursive;
+        if (!traverse && !_options.includeDirectories) {
+            return;
+        }
+
+        const int fd = openat(parentFd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+
+        if (_options.includeDirectories) {
+            DirectoryEntry entry;
+            if (statEntry(fd, nullptr, entry)) {
+                entry.path = path;
+                entries.push_back(std::move(entry));
+            }
+        }
+
+        if (!traverse) {
+            close(fd);
+        } else if (isQueueFull()) {
+            scanDirectory(fd, path, entries);
+        } else {
+            push(fd, std::move(path));
+        }
+    }
+};
+
+}
+
+bool DirectoryScanner::scan(const Path& root, std::vector<DirectoryEntry>& entries, const Options& options) {
+    std::string rootPath = root.string();
+    while (rootPath.size() > 1 && rootPath.back() == '/') {
+        rootPath.pop_back();
+    }
+
+    const int fd = open(rootPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    if (rootPath == "/") {
+        // Entries are joined with a separator
+        rootPath.clear();
+    }
+
+    Scan scan(options);
+    scan.push(fd, std::move(rootPath));
+
+    const unsigned threadCount = options.threadCount
+                               ? options.threadCount
+                               : std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<std::vector<DirectoryEntry>> results(threadCount);
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threadCount; i++) {
+        workers.emplace_back([&scan, &results, i] { scan.run(results[i]); });
+    }
+
+    scan.run(results[0]);
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    const size_t start = entries.size();
+    for (std::vector<DirectoryEntry>& result : results) {
+        entries.insert(entries.end(),
+                       std::make_move_iterator(result.begin()),
+                       std::make_move_iterator(result.end()));
+    }
+
+    std::sort(entries.begin() + start, entries.end(),
+              [](const DirectoryEntry& lhs, const DirectoryEntry& rhs) {
+                  return lhs.path.native() < rhs.path.native();
+              });
+
+    return true;
+}
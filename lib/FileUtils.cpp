@@ -2,13 +2,26 @@
 
 #include <unistd.h>
 #include <fcntl.h>
-#include <fstream>
+#include <errno.h>
 #include <sys/stat.h>
 #include <regex>
 #include <string.h>
 
 #include "StringUtils.h"
 
+namespace {
+
+ssize_t readRetry(int fd, char* buffer, size_t size) {
+    for (;;) {
+        const ssize_t bytesRead = read(fd, buffer, size);
+        if (bytesRead >= 0 || errno != EINTR) {
+            return bytesRead;
+        }
+    }
+}
+
+}
+
 bool FileUtils::exists(const FileUtils::Path& path) {
     std::error_code error;
     const bool res = std::filesystem::exists(path, error);
@@ -55,23 +68,7 @@ FileUtils::Path FileUtils::cwd() {
 }
 
 bool FileUtils::writeFile(const Path& path, const std::string& content) {
-    const int fd = open(path.string().c_str(),
-                  O_WRONLY | O_TRUNC | O_CREAT,
-                  S_IRUSR | S_IWUSR);
-    if (fd < 0) {
-        return false;
-    }
-
-    const size_t contentSize = content.size();
-    const ssize_t bytesWritten = write(fd, content.c_str(), contentSize);
-    if (bytesWritten < 0 || bytesWritten < (ssize_t)contentSize) {
-        close (fd);
-        return false;
-    }
-
-    close(fd);
-
-    return true;
+    return writeBinary(path, content.data(), content.size());
 }
 
 FileUtils::Path FileUtils::abspath(const Path& relativePath) {
@@ -81,19 +78,29 @@ FileUtils::Path FileUtils::abspath(const Path& relativePath) {
 }
 
 bool FileUtils::writeBinary(const Path& path, const char* data, size_t size) {
-    const int fd = open(path.string().c_str(),
-                  O_WRONLY | O_TRUNC | O_CREAT,
-                  S_IRUSR | S_IWUSR);
+    const int fd = openForWrite(path);
     if (fd < 0) {
         return false;
     }
 
-    const ssize_t bytesWritten = write(fd, data, size);
-    if (bytesWritten < 0 || bytesWritten < (ssize_t)size) {
-        return false;
-    }
+    const bool written = writeAll(fd, data, size);
+    return close(fd) == 0 && written;
+}
 
-    close(fd);
+bool FileUtils::writeAll(int fd, const void* data, size_t size) {
+    const char* src = static_cast<const char*>(data);
+    while (size > 0) {
+        const ssize_t bytesWritten = write(fd, src, size);
+        if (bytesWritten < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        src += bytesWritten;
+        size -= bytesWritten;
+    }
 
     return true;
 }
@@ -123,18 +130,53 @@ bool FileUtils::isFile(const Path& path) {
 }
 
 bool FileUtils::readContent(const Path& path, std::string& data) {
-    if (!isFile(path)) {
+    const int fd = open(path.string().c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
         return false;
     }
 
-    std::ifstream file(path, std::ios::in);
+    struct stat statBuf;
+    if (fstat(fd, &statBuf) != 0 || !S_ISREG(statBuf.st_mode)) {
+        close(fd);
+        return false;
+    }
 
-    if (!file.is_open())
+    // The file is read in one call of the size given by fstat. Files that
+    // report no size, e.g. in /proc, or that grew meanwhile are read
+    // further until the end of file
+    data.resize(statBuf.st_size > 0 ? statBuf.st_size : 4096);
+
+    size_t offset = 0;
+    ssize_t bytesRead = 0;
+    for (;;) {
+        if (offset == data.size()) {
+            // Check for the end of file before growing the buffer
+            char probe = 0;
+            bytesRead = readRetry(fd, &probe, 1);
+            if (bytesRead <= 0) {
+                break;
+            }
+
+            data.resize(data.size() * 2);
+            data[offset++] = probe;
+        }
+
+        bytesRead = readRetry(fd, data.data() + offset, data.size() - offset);
+        if (bytesRead <= 0) {
+            break;
+        }
+
+        offset += bytesRead;
+    }
+
+    close(fd);
+
+    if (bytesRead < 0) {
+        data.clear();
         return false;
+    }
 
-    // Read contents
-    data = {std::istreambuf_iterator<char>(file),
-            std::istreambuf_iterator<char>()};
+    data.resize(offset);
 
     return true;
 }
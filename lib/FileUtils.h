@@ -19,6 +19,7 @@ public:
     static Path getFilename(const Path& path);
     static bool writeFile(const Path& path, const std::string& content);
     static bool writeBinary(const Path& path, const char* data, size_t size);
+    static bool writeAll(int fd, const void* data, size_t size);
     static int openForRead(const Path& path);
     static int openForWrite(const Path& path);
     static bool readContent(const Path& path, std::string& data);
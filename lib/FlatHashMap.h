@@ -0,0 +1,680 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "HashUtils.h"
+
+// Open-addressing hash tables in the style of Swiss tables.
+// Each slot has a control byte holding 7 bits of its hash, or a marker for
+// empty and deleted slots. Probing loads 16 control bytes at once and matches
+// them against the hash in a single SSE2 comparison, so most lookups touch
+// one cache line of metadata and at most one slot.
+//
+// Elements are stored inline: references and iterators are invalidated by
+// any insertion that grows the table, and by rehash/reserve.
+// The keys of FlatHashMap elements must not be modified through iterators.
+//
+// Lookups are heterogeneous when both Hash and KeyEqual define is_transparent.
+
+namespace flat_hash_detail {
+
+using Ctrl = int8_t;
+
+static constexpr Ctrl EMPTY = -128;
+static constexpr Ctrl DELETED = -2;
+static constexpr Ctrl SENTINEL = -1;
+
+static constexpr size_t GROUP_WIDTH = 16;
+
+// Control bytes of tables without any slot. The sentinel ends iterations
+// and the empty bytes end probe sequences.
+alignas(GROUP_WIDTH) inline constexpr Ctrl EMPTY_GROUP[GROUP_WIDTH] = {
+    SENTINEL, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
+    EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
+};
+
+// Bits i set for the control bytes i of a group that match
+class BitMask {
+public:
+    explicit BitMask(uint32_t mask)
+        : _mask(mask)
+    {}
+
+    explicit operator bool() const { return _mask != 0; }
+
+    uint32_t lowest() const { return __builtin_ctz(_mask); }
+    uint32_t trailingZeros() const { return _mask ? __builtin_ctz(_mask) : GROUP_WIDTH; }
+    uint32_t leadingZeros() const { return _mask ? __builtin_clz(_mask) - (32 - GROUP_WIDTH) : GROUP_WIDTH; }
+
+    void next() { _mask &= _mask - 1; }
+
+private:
+    uint32_t _mask {0};
+};
+
+class Group {
+public:
+#ifdef __SSE2__
+    explicit Group(const Ctrl* ctrl)
+        : _ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl)))
+    {}
+
+    BitMask match(Ctrl h2) const {
+        return BitMask(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), _ctrl)));
+    }
+
+    BitMask matchEmpty() const {
+        return match(EMPTY);
+    }
+
+    BitMask matchEmptyOrDeleted() const {
+        return BitMask(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(SENTINEL), _ctrl)));
+    }
+
+private:
+    __m128i _ctrl;
+#else
+    explicit Group(const Ctrl* ctrl) {
+        memcpy(_ctrl, ctrl, GROUP_WIDTH);
+    }
+
+    BitMask match(Ctrl h2) const {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP_WIDTH; i++) {
+            mask |= (uint32_t)(_ctrl[i] == h2) << i;
+        }
+        return BitMask(mask);
+    }
+
+    BitMask matchEmpty() const {
+        return match(EMPTY);
+    }
+
+    BitMask matchEmptyOrDeleted() const {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP_WIDTH; i++) {
+            mask |= (uint32_t)(_ctrl[i] < SENTINEL) << i;
+        }
+        return BitMask(mask);
+    }
+
+private:
+    Ctrl _ctrl[GROUP_WIDTH];
+#endif
+};
+
+template <class Key, class Hash, class KeyEqual>
+constexpr bool IsTransparent = requires {
+    typename Hash::is_transparent;
+    typename KeyEqual::is_transparent;
+};
+
+// Type of the lookup arguments, K itself stays deducible through the aliases
+template <bool Transparent>
+struct KeyArgSelector {
+    template <class K, class Key>
+    using type = K;
+};
+
+template <>
+struct KeyArgSelector<false> {
+    template <class K, class Key>
+    using type = Key;
+};
+
+template <class Key>
+struct SetPolicy {
+    using key_type = Key;
+    using value_type = Key;
+
+    static const Key& key(const value_type& value) { return value; }
+};
+
+template <class Key, class T>
+struct MapPolicy {
+    using key_type = Key;
+    using value_type = std::pair<Key, T>;
+
+    static const Key& key(const value_type& value) { return value.first; }
+};
+
+template <class Policy, class Hash, class KeyEqual>
+class FlatHashTable {
+    template <class K>
+    using KeyArg = typename KeyArgSelector<IsTransparent<typename Policy::key_type, Hash, KeyEqual>>
+        ::template type<K, typename Policy::key_type>;
+
+    static constexpr size_t NPOS = SIZE_MAX;
+
+public:
+    using key_type = typename Policy::key_type;
+    using value_type = typename Policy::value_type;
+    using size_type = size_t;
+    using hasher = Hash;
+    using key_equal = KeyEqual;
+
+    template <bool Const>
+    class Iterator {
+    public:
+        using value_type = typename Policy::value_type;
+        using reference = std::conditional_t<Const, const value_type&, value_type&>;
+        using pointer = std::conditional_t<Const, const value_type*, value_type*>;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        Iterator() = default;
+
+        // Conversion from iterator to const_iterator
+        template <bool OtherConst>
+        requires (Const && !OtherConst)
+        Iterator(const Iterator<OtherConst>& other)
+            : _ctrl(other._ctrl),
+            _slot(other._slot)
+        {}
+
+        reference operator*() const { return *_slot; }
+        pointer operator->() const { return _slot; }
+
+        Iterator& operator++() {
+            ++_ctrl;
+            ++_slot;
+            skipFree();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator temp = *this;
+            ++*this;
+            return temp;
+        }
+
+        template <bool OtherConst>
+        bool operator==(const Iterator<OtherConst>& other) const {
+            return _ctrl == other._ctrl;
+        }
+
+    private:
+        friend FlatHashTable;
+        template <bool> friend class Iterator;
+
+        const Ctrl* _ctrl {nullptr};
+        value_type* _slot {nullptr};
+
+        Iterator(const Ctrl* ctrl, value_type* slot)
+            : _ctrl(ctrl),
+            _slot(slot)
+        {}
+
+        // Stops on full slots and on the sentinel
+        void skipFree() {
+            while (*_ctrl < SENTINEL) {
+                ++_ctrl;
+                ++_slot;
+            }
+        }
+    };
+
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    FlatHashTable() = default;
+
+    explicit FlatHashTable(size_t count) {
+        reserve(count);
+    }
+
+    FlatHashTable(const FlatHashTable& other)
+        : _hash(other._hash),
+        _equal(other._equal)
+    {
+        reserve(other._size);
+        for (const value_type& value : other) {
+            const size_t hash = hashOf(Policy::key(value));
+            const size_t index = prepareInsert(hash);
+            new (_slots + index) value_type(value);
+            commitInsert(index, hash);
+        }
+    }
+
+    FlatHashTable(FlatHashTable&& other) noexcept
+        : _hash(std::move(other._hash)),
+        _equal(std::move(other._equal)),
+        _ctrl(other._ctrl),
+        _slots(other._slots),
+        _capacity(other._capacity),
+        _size(other._size),
+        _growthLeft(other._growthLeft)
+    {
+        other.resetEmpty();
+    }
+
+    ~FlatHashTable() {
+        destroyAll();
+    }
+
+    FlatHashTable& operator=(const FlatHashTable& other) {
+        if (this != &other) {
+            FlatHashTable copy(other);
+            swap(copy);
+        }
+        return *this;
+    }
+
+    FlatHashTable& operator=(FlatHashTable&& other) noexcept {
+        if (this != &other) {
+            destroyAll();
+            _hash = std::move(other._hash);
+            _equal = std::move(other._equal);
+            _ctrl = other._ctrl;
+            _slots = other._slots;
+            _capacity = other._capacity;
+            _size = other._size;
+            _growthLeft = other._growthLeft;
+            other.resetEmpty();
+        }
+        return *this;
+    }
+
+    void swap(FlatHashTable& other) noexcept {
+        std::swap(_hash, other._hash);
+        std::swap(_equal, other._equal);
+        std::swap(_ctrl, other._ctrl);
+        std::swap(_slots, other._slots);
+        std::swap(_capacity, other._capacity);
+        std::swap(_size, other._size);
+        std::swap(_growthLeft, other._growthLeft);
+    }
+
+    iterator begin() {
+        iterator it(_ctrl, _slots);
+        it.skipFree();
+        return it;
+    }
+
+    iterator end() { return iterator(_ctrl + _capacity, _slots + _capacity); }
+
+    const_iterator begin() const { return const_cast<FlatHashTable*>(this)->begin(); }
+    const_iterator end() const { return const_cast<FlatHashTable*>(this)->end(); }
+
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    size_t capacity() const { return _capacity; }
+
+    // Keeps the allocated slots
+    void clear() {
+        if (_capacity == 0) {
+            return;
+        }
+
+        destroySlots();
+        resetCtrl();
+        _size = 0;
+    }
+
+    // Makes room for count elements without further growth
+    void reserve(size_t count) {
+        if (count <= _size + _growthLeft) {
+            return;
+        }
+
+        size_t capacity = GROUP_WIDTH - 1;
+        while (maxLoad(capacity) < count) {
+            capacity = capacity * 2 + 1;
+        }
+
+        resize(capacity);
+    }
+
+    // Rebuilds the table, dropping the deleted markers left by erase
+    void rehash() {
+        if (_capacity != 0) {
+            resize(_capacity);
+        }
+    }
+
+    template <class K = key_type>
+    iterator find(const KeyArg<K>& key) {
+        const size_t index = findIndex(key, hashOf(key));
+        return index == NPOS ? end() : iteratorAt(index);
+    }
+
+    template <class K = key_type>
+    const_iterator find(const KeyArg<K>& key) const {
+        return const_cast<FlatHashTable*>(this)->find(key);
+    }
+
+    template <class K = key_type>
+    bool contains(const KeyArg<K>& key) const {
+        return findIndex(key, hashOf(key)) != NPOS;
+    }
+
+    template <class K = key_type>
+    size_t count(const KeyArg<K>& key) const {
+        return contains(key) ? 1 : 0;
+    }
+
+    template <class K = key_type>
+    size_t erase(const KeyArg<K>& key) {
+        const size_t index = findIndex(key, hashOf(key));
+        if (index == NPOS) {
+            return 0;
+        }
+
+        eraseAt(index);
+        return 1;
+    }
+
+    // Returns the iterator following pos
+    iterator erase(const_iterator pos) {
+        const size_t index = pos._ctrl - _ctrl;
+        eraseAt(index);
+
+        iterator it = iteratorAt(index);
+        it.skipFree();
+        return it;
+    }
+
+    std::pair<iterator, bool> insert(const value_type& value) {
+        return emplaceKey(Policy::key(value), value);
+    }
+
+    std::pair<iterator, bool> insert(value_type&& value) {
+        return emplaceKey(Policy::key(value), std::move(value));
+    }
+
+    template <class InputIt>
+    void insert(InputIt first, InputIt last) {
+        for (; first != last; ++first) {
+            insert(*first);
+        }
+    }
+
+    // Constructs the element before looking up its key,
+    // prefer insert or try_emplace when the key is at hand
+    template <class... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        value_type value(std::forward<Args>(args)...);
+        return emplaceKey(Policy::key(value), std::move(value));
+    }
+
+protected:
+    // Inserts the element constructed from args if key is not in the table
+    template <class K, class... Args>
+    std::pair<iterator, bool> emplaceKey(const K& key, Args&&... args) {
+        const size_t hash = hashOf(key);
+        const size_t found = findIndex(key, hash);
+        if (found != NPOS) {
+            return {iteratorAt(found), false};
+        }
+
+        const size_t index = prepareInsert(hash);
+        new (_slots + index) value_type(std::forward<Args>(args)...);
+        commitInsert(index, hash);
+        return {iteratorAt(index), true};
+    }
+
+    iterator iteratorAt(size_t index) {
+        return iterator(_ctrl + index, _slots + index);
+    }
+
+    template <class K>
+    size_t hashOf(const K& key) const {
+        // std::hash is the identity for integers on most standard libraries,
+        // which would leave the 7 bits of the control bytes constant
+        return HashUtils::hashInt(_hash(key));
+    }
+
+private:
+    [[no_unique_address]] Hash _hash;
+    [[no_unique_address]] KeyEqual _equal;
+
+    // _capacity is zero or a power of two minus one. The control bytes are
+    // followed by a sentinel and by a copy of the first GROUP_WIDTH-1 bytes,
+    // so that groups can be loaded at any position without wrapping
+    Ctrl* _ctrl {const_cast<Ctrl*>(EMPTY_GROUP)};
+    value_type* _slots {nullptr};
+    size_t _capacity {0};
+    size_t _size {0};
+
+    // Empty slots that can still be used before growing
+    size_t _growthLeft {0};
+
+    // Maximum load factor of 7/8
+    static size_t maxLoad(size_t capacity) {
+        return capacity - capacity / 8;
+    }
+
+    static size_t h1(size_t hash) { return hash >> 7; }
+    static Ctrl h2(size_t hash) { return hash & 0x7F; }
+
+    static size_t ctrlBytes(size_t capacity) {
+        return capacity + GROUP_WIDTH;
+    }
+
+    // Triangular probing over groups, visits every group when the number of
+    // control bytes before the sentinel is a power of two
+    template <class K>
+    size_t findIndex(const K& key, size_t hash) const {
+        const Ctrl tag = h2(hash);
+        size_t pos = h1(hash) & _capacity;
+        size_t step = 0;
+
+        for (;;) {
+            const Group group(_ctrl + pos);
+            for (BitMask match = group.match(tag); match; match.next()) {
+                const size_t index = (pos + match.lowest()) & _capacity;
+                if (_equal(Policy::key(_slots[index]), key)) {
+                    [[likely]]
+                    return index;
+                }
+            }
+
+            if (group.matchEmpty()) {
+                [[likely]]
+                return NPOS;
+            }
+
+            step += GROUP_WIDTH;
+            pos = (pos + step) & _capacity;
+        }
+    }
+
+    size_t findFirstFree(size_t hash) const {
+        size_t pos = h1(hash) & _capacity;
+        size_t step = 0;
+
+        for (;;) {
+            const BitMask free = Group(_ctrl + pos).matchEmptyOrDeleted();
+            if (free) {
+                [[likely]]
+                return (pos + free.lowest()) & _capacity;
+            }
+
+            step += GROUP_WIDTH;
+            pos = (pos + step) & _capacity;
+        }
+    }
+
+    // Finds a free slot for a new element of the given hash, growing if needed.
+    // The slot is only marked as full by commitInsert, once the element is
+    // constructed, so that a throwing constructor leaves the table consistent
+    size_t prepareInsert(size_t hash) {
+        const size_t index = findFirstFree(hash);
+        if (_growthLeft == 0 && _ctrl[index] != DELETED) {
+            grow();
+            return findFirstFree(hash);
+        }
+
+        return index;
+    }
+
+    void commitInsert(size_t index, size_t hash) {
+        _growthLeft -= _ctrl[index] == EMPTY;
+        setCtrl(index, h2(hash));
+        _size++;
+    }
+
+    void setCtrl(size_t index, Ctrl value) {
+        _ctrl[index] = value;
+        _ctrl[((index - (GROUP_WIDTH - 1)) & _capacity) + (GROUP_WIDTH - 1)] = value;
+    }
+
+    void eraseAt(size_t index) {
+        _slots[index].~value_type();
+        _size--;
+
+        // The slot can become empty again if no probe sequence ever went past
+        // it, which is the case if no window of GROUP_WIDTH bytes around it was full
+        const size_t indexBefore = (index - GROUP_WIDTH) & _capacity;
+        const BitMask emptyAfter = Group(_ctrl + index).matchEmpty();
+        const BitMask emptyBefore = Group(_ctrl + indexBefore).matchEmpty();
+        const bool wasNeverFull = emptyBefore && emptyAfter
+            && emptyAfter.trailingZeros() + emptyBefore.leadingZeros() < GROUP_WIDTH;
+
+        setCtrl(index, wasNeverFull ? EMPTY : DELETED);
+        _growthLeft += wasNeverFull;
+    }
+
+    void grow() {
+        // Mostly deleted markers, rebuild in place rather than doubling
+        if (_capacity > GROUP_WIDTH && _size * 32 <= _capacity * 25) {
+            resize(_capacity);
+        } else {
+            resize(_capacity == 0 ? GROUP_WIDTH - 1 : _capacity * 2 + 1);
+        }
+    }
+
+    void resize(size_t capacity) {
+        Ctrl* oldCtrl = _ctrl;
+        value_type* oldSlots = _slots;
+        const size_t oldCapacity = _capacity;
+
+        _ctrl = new Ctrl[ctrlBytes(capacity)];
+        _slots = std::allocator<value_type>().allocate(capacity);
+        _capacity = capacity;
+        resetCtrl();
+
+        for (size_t i = 0; i < oldCapacity; i++) {
+            if (oldCtrl[i] >= 0) {
+                value_type& value = oldSlots[i];
+                const size_t hash = hashOf(Policy::key(value));
+                const size_t index = findFirstFree(hash);
+                setCtrl(index, h2(hash));
+                new (_slots + index) value_type(std::move(value));
+                value.~value_type();
+            }
+        }
+
+        _growthLeft -= _size;
+
+        if (oldCapacity != 0) {
+            delete[] oldCtrl;
+            std::allocator<value_type>().deallocate(oldSlots, oldCapacity);
+        }
+    }
+
+    void resetCtrl() {
+        memset(_ctrl, EMPTY, ctrlBytes(_capacity));
+        _ctrl[_capacity] = SENTINEL;
+        _growthLeft = maxLoad(_capacity);
+    }
+
+    void resetEmpty() {
+        _ctrl = const_cast<Ctrl*>(EMPTY_GROUP);
+        _slots = nullptr;
+        _capacity = 0;
+        _size = 0;
+        _growthLeft = 0;
+    }
+
+    void destroySlots() {
+        if constexpr (!std::is_trivially_destructible_v<value_type>) {
+            for (size_t i = 0; i < _capacity; i++) {
+                if (_ctrl[i] >= 0) {
+                    _slots[i].~value_type();
+                }
+            }
+        }
+    }
+
+    void destroyAll() {
+        if (_capacity == 0) {
+            return;
+        }
+
+        destroySlots();
+        delete[] _ctrl;
+        std::allocator<value_type>().deallocate(_slots, _capacity);
+        resetEmpty();
+    }
+};
+
+}
+
+template <class Key,
+          class Hash = std::hash<Key>,
+          class KeyEqual = std::equal_to<Key>>
+class FlatHashSet : public flat_hash_detail::FlatHashTable<flat_hash_detail::SetPolicy<Key>, Hash, KeyEqual> {
+public:
+    using Base = flat_hash_detail::FlatHashTable<flat_hash_detail::SetPolicy<Key>, Hash, KeyEqual>;
+    using Base::Base;
+};
+
+template <class Key,
+          class T,
+          class Hash = std::hash<Key>,
+          class KeyEqual = std::equal_to<Key>>
+class FlatHashMap : public flat_hash_detail::FlatHashTable<flat_hash_detail::MapPolicy<Key, T>, Hash, KeyEqual> {
+public:
+    using Base = flat_hash_detail::FlatHashTable<flat_hash_detail::MapPolicy<Key, T>, Hash, KeyEqual>;
+    using mapped_type = T;
+    using typename Base::iterator;
+    using Base::Base;
+
+    // Constructs the mapped value from args only if key is not in the map
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+        return this->emplaceKey(key,
+                                std::piecewise_construct,
+                                std::forward_as_tuple(key),
+                                std::forward_as_tuple(std::forward<Args>(args)...));
+    }
+
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args) {
+        return this->emplaceKey(key,
+                                std::piecewise_construct,
+                                std::forward_as_tuple(std::move(key)),
+                                std::forward_as_tuple(std::forward<Args>(args)...));
+    }
+
+    template <class M>
+    std::pair<iterator, bool> insert_or_assign(const Key& key, M&& value) {
+        auto res = try_emplace(key, std::forward<M>(value));
+        if (!res.second) {
+            res.first->second = std::forward<M>(value);
+        }
+        return res;
+    }
+
+    T& operator[](const Key& key) {
+        return try_emplace(key).first->second;
+    }
+
+    T& operator[](Key&& key) {
+        return try_emplace(std::move(key)).first->second;
+    }
+};
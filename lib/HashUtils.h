@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Hashing of contiguous bytes based on wyhash (public domain, Wang Yi).
+// Inputs of 48 bytes and more are processed in three independent lanes of
+// 64x64->128 multiplications, which keeps the multipliers of the core busy.
+class HashUtils {
+public:
+    HashUtils() = delete;
+
+    static uint64_t hashBytes(const void* data, size_t len, uint64_t seed = 0) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        seed ^= mix(seed ^ SECRET[0], SECRET[1]);
+
+        uint64_t a = 0;
+        uint64_t b = 0;
+
+        if (len <= 16) {
+            [[likely]]
+            if (len >= 4) {
+                const size_t shift = (len >> 3) << 2;
+                a = (read4(p) << 32) | read4(p + shift);
+                b = (read4(p + len - 4) << 32) | read4(p + len - 4 - shift);
+            } else if (len > 0) {
+                a = read3(p, len);
+            }
+        } else {
+            size_t i = len;
+            if (i >= 48) {
+                uint64_t seed1 = seed;
+                uint64_t seed2 = seed;
+                do {
+                    seed = mix(read8(p) ^ SECRET[1], read8(p + 8) ^ seed);
+                    seed1 = mix(read8(p + 16) ^ SECRET[2], read8(p + 24) ^ seed1);
+                    seed2 = mix(read8(p + 32) ^ SECRET[3], read8(p + 40) ^ seed2);
+                    p += 48;
+                    i -= 48;
+                } while (i >= 48);
+
+                seed ^= seed1 ^ seed2;
+            }
+
+            while (i > 16) {
+                seed = mix(read8(p) ^ SECRET[1], read8(p + 8) ^ seed);
+                i -= 16;
+                p += 16;
+            }
+
+            a = read8(p + i - 16);
+            b = read8(p + i - 8);
+        }
+
+        a ^= SECRET[1];
+        b ^= seed;
+        multiply(a, b);
+
+        return mix(a ^ SECRET[0] ^ len, b ^ SECRET[1]);
+    }
+
+    // Combines the hash of a new value into seed, order dependent
+    static uint64_t hashCombine(uint64_t seed, uint64_t value) {
+        return mix(seed ^ SECRET[0], value ^ SECRET[1]);
+    }
+
+    // Avalanche of a single 64-bit value
+    static uint64_t hashInt(uint64_t value) {
+        return mix(value ^ SECRET[0], SECRET[1]);
+    }
+
+private:
+    static constexpr uint64_t SECRET[4] = {
+        0x2d358dccaa6c78a5ull,
+        0x8bb84b93962eacc9ull,
+        0x4b33a62ed433d4a3ull,
+        0x4d5a2da51de1aa47ull,
+    };
+
+    static void multiply(uint64_t& a, uint64_t& b) {
+        const __uint128_t r = (__uint128_t)a * b;
+        a = (uint64_t)r;
+        b = (uint64_t)(r >> 64);
+    }
+
+    static uint64_t mix(uint64_t a, uint64_t b) {
+        multiply(a, b);
+        return a ^ b;
+    }
+
+    static uint64_t read8(const uint8_t* p) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static uint64_t read4(const uint8_t* p) {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static uint64_t read3(const uint8_t* p, size_t k) {
+        return ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) | p[k - 1];
+    }
+};
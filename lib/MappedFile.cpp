@@ -0,0 +1,127 @@
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <utility>
+
+namespace {
+
+int getAdvice(MappedFile::Access access) {
+    switch (access) {
+        case MappedFile::Access::Normal: return MADV_NORMAL;
+        case MappedFile::Access::Sequential: return MADV_SEQUENTIAL;
+        case MappedFile::Access::Random: return MADV_RANDOM;
+        case MappedFile::Access::WillNeed: return MADV_WILLNEED;
+    }
+    return MADV_NORMAL;
+}
+
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : _data(std::exchange(other._data, nullptr)),
+    _size(std::exchange(other._size, 0)),
+    _mode(other._mode)
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        _data = std::exchange(other._data, nullptr);
+        _size = std::exchange(other._size, 0);
+        _mode = other._mode;
+    }
+    return *this;
+}
+
+std::optional<MappedFile> MappedFile::open(const Path& path,
+                                           Mode mode,
+                                           Access access,
+                                           bool populate) {
+    const bool writable = mode == Mode::ReadWrite;
+    const int fd = ::open(path.string().c_str(), (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+
+    struct stat statBuf;
+    if (fstat(fd, &statBuf) != 0 || !S_ISREG(statBuf.st_mode)) {
+        ::close(fd);
+        return std::nullopt;
+    }
+
+    MappedFile file;
+    file._mode = mode;
+    file._size = statBuf.st_size;
+
+    if (file._size == 0) {
+        // mmap does not accept empty mappings
+        ::close(fd);
+        return file;
+    }
+
+    const int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    int flags = writable ? MAP_SHARED : MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if (populate) {
+        flags |= MAP_POPULATE;
+    }
+#endif
+    void* data = mmap(nullptr, file._size, prot, flags, fd, 0);
+
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+
+    if (data == MAP_FAILED) {
+        file._size = 0;
+        return std::nullopt;
+    }
+
+    file._data = static_cast<char*>(data);
+
+#ifndef MAP_POPULATE
+    // Starts reading the pages ahead, without waiting for them
+    if (populate) {
+        madvise(data, file._size, MADV_WILLNEED);
+    }
+#endif
+
+    if (access != Access::Normal) {
+        file.advise(access);
+    }
+
+    return file;
+}
+
+bool MappedFile::advise(Access access) {
+    if (!_data) {
+        return true;
+    }
+
+    return madvise(_data, _size, getAdvice(access)) == 0;
+}
+
+bool MappedFile::sync(bool async) {
+    if (!_data || _mode != Mode::ReadWrite) {
+        return true;
+    }
+
+    return msync(_data, _size, async ? MS_ASYNC : MS_SYNC) == 0;
+}
+
+void MappedFile::close() {
+    if (_data) {
+        munmap(_data, _size);
+    }
+
+    _data = nullptr;
+    _size = 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stddef.h>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+
+// Memory mapping of a whole file, unmapped on destruction.
+//
+// ReadOnly maps a private read-only view, ReadWrite a shared writable one
+// whose changes go to the file (flushed by sync or by the kernel).
+// The access hint is passed to madvise, and populate pre-faults all the
+// pages at open time (MAP_POPULATE) so that later accesses never block on
+// the disk. Without MAP_POPULATE (macOS), populate only starts reading the
+// pages ahead with MADV_WILLNEED. An empty file gives an empty mapping.
+class MappedFile {
+public:
+    using Path = std::filesystem::path;
+
+    enum class Mode {
+        ReadOnly,
+        ReadWrite,
+    };
+
+    enum class Access {
+        Normal,
+        Sequential,
+        Random,
+        WillNeed,
+    };
+
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    [[nodiscard]] static std::optional<MappedFile> open(const Path& path,
+                                                        Mode mode = Mode::ReadOnly,
+                                                        Access access = Access::Normal,
+                                                        bool populate = false);
+
+    std::span<const char> span() const { return {_data, _size}; }
+    std::string_view view() const { return {_data, _size}; }
+    const char* data() const { return _data; }
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    Mode mode() const { return _mode; }
+
+    // Writable view, empty for a ReadOnly mapping
+    std::span<char> mutableSpan() {
+        return _mode == Mode::ReadWrite ? std::span<char>(_data, _size) : std::span<char>();
+    }
+
+    // Changes the access hint of the whole mapping
+    bool advise(Access access);
+
+    // Writes the changes of a ReadWrite mapping back to the file,
+    // waiting for the writes to complete unless async
+    bool sync(bool async = false);
+
+    void close();
+
+private:
+    char* _data {nullptr};
+    size_t _size {0};
+    Mode _mode {Mode::ReadOnly};
+};
@@ -0,0 +1,11 @@
+#include "NumberFormat.h"
+
+#include <charconv>
+
+size_t NumberFormat::formatFloat(double value, char* out) {
+    return std::to_chars(out, out + maxChars<double>(), value).ptr - out;
+}
+
+size_t NumberFormat::formatFloat(float value, char* out) {
+    return std::to_chars(out, out + maxChars<float>(), value).ptr - out;
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <bit>
+#include <concepts>
+#include <limits>
+#include <ranges>
+#include <span>
+#include <string>
+#include <type_traits>
+
+template <typename NumberType>
+concept FormattableNumber = std::is_arithmetic_v<NumberType>
+                         && !std::same_as<NumberType, bool>
+                         && !std::same_as<NumberType, char>
+                         && !std::same_as<NumberType, long double>;
+
+// Formatting of numbers in decimal directly into a caller-provided buffer,
+// without allocation nor locale. The buffer must hold at least
+// maxChars<NumberType>() characters per value, nothing is null-terminated.
+// Integers are written two digits at a time from a table of digit pairs,
+// floating point numbers in the shortest form that parses back to the same
+// value (std::to_chars), e.g. 0.1 gives "0.1" and 1e+100 gives "1e+100".
+class NumberFormat {
+public:
+    NumberFormat() = delete;
+
+    template <FormattableNumber NumberType>
+    static constexpr size_t maxChars() {
+        if constexpr (std::is_floating_point_v<NumberType>) {
+            // "-2.2250738585072014e-308"
+            return sizeof(NumberType) <= sizeof(float) ? 15 : 24;
+        } else {
+            // Digits of the maximum value and the sign
+            return std::numeric_limits<NumberType>::digits10 + 1 + std::is_signed_v<NumberType>;
+        }
+    }
+
+    // Returns the number of characters written to out
+    template <FormattableNumber NumberType>
+    static size_t format(NumberType value, char* out) {
+        if constexpr (std::is_floating_point_v<NumberType>) {
+            return formatFloat(value, out);
+        } else if constexpr (std::is_signed_v<NumberType>) {
+            if (value < 0) {
+                *out = '-';
+                return 1 + formatUnsigned(0 - (uint64_t)value, out + 1);
+            }
+            return formatUnsigned((uint64_t)value, out);
+        } else {
+            return formatUnsigned((uint64_t)value, out);
+        }
+    }
+
+    template <FormattableNumber NumberType>
+    static void append(NumberType value, std::string& out) {
+        const size_t size = out.size();
+        out.resize(size + maxChars<NumberType>());
+        out.resize(size + format(value, out.data() + size));
+    }
+
+    // Size of a buffer large enough to format count values with separators
+    template <FormattableNumber NumberType>
+    static constexpr size_t maxColumnSize(size_t count) {
+        return count * (maxChars<NumberType>() + 1);
+    }
+
+    // Formats values separated by separator, without a trailing separator.
+    // out must hold at least maxColumnSize<NumberType>(values.size())
+    // characters. Returns the number of characters written
+    template <FormattableNumber NumberType>
+    static size_t formatColumn(std::span<const NumberType> values, char separator, char* out) {
+        if (values.empty()) {
+            return 0;
+        }
+
+        char* pos = out + format(values[0], out);
+        for (size_t i = 1; i < values.size(); i++) {
+            *pos++ = separator;
+            pos += format(values[i], pos);
+        }
+
+        return pos - out;
+    }
+
+    template <FormattableNumber NumberType>
+    static void appendColumn(std::span<const NumberType> values, char separator, std::string& out) {
+        const size_t size = out.size();
+        out.resize(size + maxColumnSize<NumberType>(values.size()));
+        out.resize(size + formatColumn(values, separator, out.data() + size));
+    }
+
+    // Same for any contiguous range of numbers, e.g. a std::vector
+    template <std::ranges::contiguous_range Range>
+        requires std::ranges::sized_range<Range>
+              && FormattableNumber<std::ranges::range_value_t<Range>>
+    static size_t formatColumn(const Range& values, char separator, char* out) {
+        using NumberType = std::ranges::range_value_t<Range>;
+        return formatColumn(std::span<const NumberType>(values), separator, out);
+    }
+
+    template <std::ranges::contiguous_range Range>
+        requires std::ranges::sized_range<Range>
+              && FormattableNumber<std::ranges::range_value_t<Range>>
+    static void appendColumn(const Range& values, char separator, std::string& out) {
+        using NumberType = std::ranges::range_value_t<Range>;
+        appendColumn(std::span<const NumberType>(values), separator, out);
+    }
+
+    // Number of decimal digits of value, at least 1
+    static size_t countDigits(uint64_t value) {
+        // log10(2) ~= 1233 / 4096 gives the digit count up to one
+        const size_t approx = (std::bit_width(value | 1) * 1233) >> 12;
+        return approx + ((value | 1) >= POWERS_OF_10[approx]);
+    }
+
+    static size_t formatUnsigned(uint64_t value, char* out) {
+        const size_t digits = countDigits(value);
+        char* pos = out + digits;
+
+        while (value >= 100) {
+            const size_t pair = (value % 100) * 2;
+            value /= 100;
+            pos -= 2;
+            memcpy(pos, DIGIT_PAIRS + pair, 2);
+        }
+
+        if (value >= 10) {
+            memcpy(pos - 2, DIGIT_PAIRS + value * 2, 2);
+        } else {
+            pos[-1] = '0' + value;
+        }
+
+        return digits;
+    }
+
+    static size_t formatFloat(double value, char* out);
+    static size_t formatFloat(float value, char* out);
+
+private:
+    static constexpr char DIGIT_PAIRS[201] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+    static constexpr uint64_t POWERS_OF_10[20] = {
+        1ull,
+        10ull,
+        100ull,
+        1000ull,
+        10000ull,
+        100000ull,
+        1000000ull,
+        10000000ull,
+        100000000ull,
+        1000000000ull,
+        10000000000ull,
+        100000000000ull,
+        1000000000000ull,
+        10000000000000ull,
+        100000000000000ull,
+        1000000000000000ull,
+        10000000000000000ull,
+        100000000000000000ull,
+        1000000000000000000ull,
+        10000000000000000000ull,
+    };
+};
@@ -0,0 +1,141 @@
+#include "PerfCounters.h"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef __linux__
+
+struct EventConfig {
+    uint32_t _type {0};
+    uint64_t _config {0};
+};
+
+constexpr uint64_t cacheConfig(uint64_t cache) {
+    return cache
+         | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+         | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+constexpr std::array<EventConfig, PerfCounters::EventCount> eventConfigs = {{
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, cacheConfig(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HW_CACHE, cacheConfig(PERF_COUNT_HW_CACHE_LL)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, cacheConfig(PERF_COUNT_HW_CACHE_DTLB)},
+}};
+
+int openEvent(const EventConfig& config, int groupFd) {
+    perf_event_attr attr {};
+    attr.size = sizeof(attr);
+    attr.type = config._type;
+    attr.config = config._config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    // Measure the calling thread on any cpu
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0);
+}
+
+#endif
+
+}
+
+PerfCounters::PerfCounters()
+{
+    _fds.fill(-1);
+
+#ifdef __linux__
+    // The cycles counter leads the group, without it nothing is measured
+    for (size_t i = 0; i < EventCount; i++) {
+        if (i != 0 && _leaderFd < 0) {
+            break;
+        }
+
+        const int fd = openEvent(eventConfigs[i], _leaderFd);
+        if (fd < 0) {
+            continue;
+        }
+
+        if (i == 0) {
+            _leaderFd = fd;
+        }
+
+        _fds[i] = fd;
+        _readOrder[_openedCount++] = (Event)i;
+        _availMask |= 1u << i;
+    }
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+    for (const int fd : _fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+#endif
+}
+
+bool PerfCounters::read(Values& values) const {
+    values.fill(0);
+
+    if (_leaderFd < 0) {
+        return false;
+    }
+
+#ifdef __linux__
+    // PERF_FORMAT_GROUP layout: nr followed by the values in opening order
+    uint64_t buffer[1 + EventCount];
+    const ssize_t bytesRead = ::read(_leaderFd, buffer, sizeof(buffer));
+    if (bytesRead < (ssize_t)sizeof(uint64_t)) {
+        return false;
+    }
+
+    const size_t count = std::min((size_t)buffer[0], _openedCount);
+    for (size_t i = 0; i < count; i++) {
+        values[(size_t)_readOrder[i]] = buffer[1 + i];
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+const char* PerfCounters::getName(Event event) {
+    switch (event) {
+        case Event::Cycles: {
+            return "cycles";
+        }
+        case Event::Instructions: {
+            return "instructions";
+        }
+        case Event::L1DMisses: {
+            return "L1D miss";
+        }
+        case Event::LLCMisses: {
+            return "LLC miss";
+        }
+        case Event::BranchMisses: {
+            return "branch miss";
+        }
+        case Event::DTLBMisses: {
+            return "dTLB miss";
+        }
+        case Event::_SIZE: {
+            break;
+        }
+    }
+
+    return "unknown";
+}
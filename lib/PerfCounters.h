@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+
+// Group of hardware performance counters measuring the calling thread,
+// user space only. Counters that can not be opened (perf_event_paranoid,
+// virtualized PMU, non-Linux platforms) are reported as unavailable.
+class PerfCounters {
+public:
+    enum class Event {
+        Cycles = 0,
+        Instructions,
+        L1DMisses,
+        LLCMisses,
+        BranchMisses,
+        DTLBMisses,
+        _SIZE
+    };
+
+    static constexpr size_t EventCount = (size_t)Event::_SIZE;
+    using Values = std::array<uint64_t, EventCount>;
+
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters(PerfCounters&&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+    PerfCounters& operator=(PerfCounters&&) = delete;
+
+    bool isAvailable() const { return _availMask != 0; }
+    bool isAvailable(Event event) const { return _availMask & (1u << (size_t)event); }
+    uint32_t getAvailableMask() const { return _availMask; }
+
+    // Reads all counters in a single syscall, unavailable counters are zero
+    bool read(Values& values) const;
+
+    static const char* getName(Event event);
+
+private:
+    int _leaderFd {-1};
+    std::array<int, EventCount> _fds;
+    std::array<Event, EventCount> _readOrder;
+    size_t _openedCount {0};
+    uint32_t _availMask {0};
+};
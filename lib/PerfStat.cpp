@@ -1,28 +1,74 @@
 #include "PerfStat.h"
 
+#include <algorithm>
+#include <fcntl.h>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <stdlib.h>
+#include <string.h>
 #include <string>
+#include <sys/resource.h>
+#include <unistd.h>
 
 #ifdef __APPLE__
 #include <mach/mach.h>
 #endif
 
+#include <spdlog/fmt/bundled/format.h>
+
 #include "BioAssert.h"
+#include "ResourceSampler.h"
+
+namespace {
+
+// /proc/thread-self/io resolves to the thread that opens it, so each
+// thread keeps its own descriptor, opened on first use
+struct ThreadIoFile {
+    int fd {-1};
+    bool opened {false};
+
+    ~ThreadIoFile() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    int get() {
+        if (!opened) {
+            opened = true;
+            fd = ::open("/proc/thread-self/io", O_RDONLY | O_CLOEXEC);
+        }
+
+        return fd;
+    }
+};
+
+thread_local ThreadIoFile threadIoFile;
+
+}
 
 PerfStat* PerfStat::_instance = nullptr;
+uint64_t PerfStat::_lastGeneration = 0;
+bool PerfStat::_defaultEventLines = false;
 
 PerfStat::PerfStat()
 {
 }
 
-void PerfStat::init(const Path& logFile) {
+PerfStat::~PerfStat() {
+}
+
+void PerfStat::init(const Path& logFile, std::chrono::milliseconds samplingInterval) {
     if (_instance) {
         return;
     }
 
     _instance = new PerfStat;
+    _instance->_generation = ++_lastGeneration;
+    _instance->_eventLines = _defaultEventLines;
     _instance->open(logFile);
+    _instance->startSampler(logFile, samplingInterval);
 }
 
 PerfStat* PerfStat::getInstance() {
@@ -31,6 +77,11 @@ PerfStat* PerfStat::getInstance() {
 
 void PerfStat::destroy() {
     if (_instance) {
+        if (_instance->_sampler) {
+            _instance->_sampler->stop();
+        }
+
+        _instance->reportPhases();
         _instance->reportTotalMem();
         _instance->close();
         delete _instance;
@@ -39,6 +90,118 @@ void PerfStat::destroy() {
     _instance = nullptr;
 }
 
+void PerfStat::setEventLines(bool enabled) {
+    _defaultEventLines = enabled;
+
+    if (_instance) {
+        std::scoped_lock guard(_instance->_mutex);
+        _instance->_eventLines = enabled;
+    }
+}
+
+size_t PerfStat::enterPhase(size_t parent, std::string_view name) {
+    std::scoped_lock guard(_mutex);
+    if (parent >= _phases.size()) {
+        parent = 0;
+    }
+
+    for (const size_t child : _phases[parent].children) {
+        if (_phases[child].name == name) {
+            return child;
+        }
+    }
+
+    const size_t phase = _phases.size();
+    _phases.push_back({
+        .name = std::string(name),
+        .parent = parent,
+    });
+    _phases[parent].children.push_back(phase);
+
+    return phase;
+}
+
+void PerfStat::leavePhase(size_t phase, const PhaseSample& sample) {
+    std::scoped_lock guard(_mutex);
+    if (phase == 0 || phase >= _phases.size()) {
+        return;
+    }
+
+    Phase& data = _phases[phase];
+    data.min = data.count == 0 ? sample.seconds : std::min(data.min, sample.seconds);
+    data.max = std::max(data.max, sample.seconds);
+    data.total += sample.seconds;
+    data.count++;
+    data.userTime += sample.userTime;
+    data.sysTime += sample.sysTime;
+    data.minorFaults += sample.minorFaults;
+    data.majorFaults += sample.majorFaults;
+    data.voluntarySwitches += sample.voluntarySwitches;
+    data.involuntarySwitches += sample.involuntarySwitches;
+    data.peakRss = std::max(data.peakRss, sample.peakRss);
+    data.allocCount += sample.allocs.allocCount;
+    data.allocBytes += sample.allocs.allocBytes;
+    data.freedBytes += sample.allocs.freedBytes;
+    data.peakAllocBytes = std::max(data.peakAllocBytes, sample.allocs.peakBytes);
+    data.io.rchar += sample.io.rchar;
+    data.io.wchar += sample.io.wchar;
+    data.io.readSyscalls += sample.io.readSyscalls;
+    data.io.writeSyscalls += sample.io.writeSyscalls;
+    data.io.readBytes += sample.io.readBytes;
+    data.io.writeBytes += sample.io.writeBytes;
+}
+
+void PerfStat::reportPhases() {
+    std::scoped_lock guard(_mutex);
+    if (_phases[0].children.empty()) {
+        return;
+    }
+
+    _outStream << '\n' << "Phases:\n";
+    if (_ioFd >= 0) {
+        _outStream << (_threadIo ? "I/O per thread from /proc/thread-self/io\n"
+                                 : "I/O of the whole process from /proc/self/io\n");
+    }
+
+    _outStream << std::fixed << std::setprecision(6);
+    reportPhase(0, 0);
+    _outStream << std::defaultfloat;
+}
+
+void PerfStat::reportPhase(size_t phase, size_t depth) {
+    for (const size_t child : _phases[phase].children) {
+        const Phase& data = _phases[child];
+        _outStream << std::string(depth * 2, ' ')
+                   << '[' << data.name << "] "
+                   << "count=" << data.count
+                   << ", total=" << data.total << " s"
+                   << ", min=" << data.min << " s"
+                   << ", max=" << data.max << " s"
+                   << " [user=" << data.userTime << "s"
+                   << ", sys=" << data.sysTime << "s"
+                   << ", minflt=" << data.minorFaults
+                   << ", majflt=" << data.majorFaults
+                   << ", vcsw=" << data.voluntarySwitches
+                   << ", ivcsw=" << data.involuntarySwitches
+                   << ", peak=" << data.peakRss << "MB]";
+
+        if constexpr (AllocTracker::enabled) {
+            _outStream << " [allocs=" << data.allocCount
+                       << ", allocated=" << data.allocBytes << "B"
+                       << ", freed=" << data.freedBytes << "B"
+                       << ", peak=" << data.peakAllocBytes << "B]";
+        }
+
+        if (_ioFd >= 0) {
+            _outStream << ' ' << formatIoUsage(data.io, data.total);
+        }
+
+        _outStream << '\n';
+
+        reportPhase(child, depth + 1);
+    }
+}
+
 void PerfStat::open(const Path& logFile) {
     _outStream.open(logFile);
 
@@ -48,10 +211,57 @@ void PerfStat::open(const Path& logFile) {
         exit(EXIT_FAILURE);
         return;
     }
+
+#ifndef __APPLE__
+    constexpr const char* statmFileName = "/proc/self/statm";
+    _statmFd = ::open(statmFileName, O_RDONLY | O_CLOEXEC);
+    bioassert(_statmFd >= 0, "Failed to open {}", statmFileName);
+    _pageSize = sysconf(_SC_PAGESIZE);
+
+    // Not readable in some containers, I/O is then not reported.
+    // Per thread since Linux 3.17, process-wide before
+    _ioFd = ::open("/proc/self/io", O_RDONLY | O_CLOEXEC);
+    _threadIo = _ioFd >= 0 && threadIoFile.get() >= 0;
+#endif
+}
+
+void PerfStat::startSampler(const Path& logFile, std::chrono::milliseconds samplingInterval) {
+    if (samplingInterval.count() == 0) {
+        const char* intervalEnv = getenv("TURING_PERF_SAMPLING_MS");
+        if (!intervalEnv) {
+            return;
+        }
+
+        samplingInterval = std::chrono::milliseconds(strtoul(intervalEnv, nullptr, 10));
+    }
+
+    if (samplingInterval.count() <= 0) {
+        return;
+    }
+
+    Path samplesFile = logFile;
+    samplesFile.replace_extension(".samples.jsonl");
+
+    _sampler = std::make_unique<ResourceSampler>(samplesFile, samplingInterval);
+    if (!_sampler->start()) {
+        std::cerr << "WARNING: failed to start the resource sampler writing to '"
+                  << samplesFile << "'.\n";
+        _sampler.reset();
+    }
 }
 
 void PerfStat::close() {
     _outStream.close();
+
+    if (_statmFd >= 0) {
+        ::close(_statmFd);
+        _statmFd = -1;
+    }
+
+    if (_ioFd >= 0) {
+        ::close(_ioFd);
+        _ioFd = -1;
+    }
 }
 
 void PerfStat::reportTotalMem() {
@@ -60,9 +270,16 @@ void PerfStat::reportTotalMem() {
     }
 
     const auto [reserved, physical] = getMemInMegabytes();
+    const ResourceUsage usage = getResourceUsage();
     _outStream << '\n'
                << "Total virtual memory reserved at exit: "
-               << reserved << "MB (physical: " << physical << "MB)\n";
+               << reserved << "MB (physical: " << physical << "MB)\n"
+               << "Peak physical memory: " << usage.peakRss << "MB\n"
+               << "CPU time: user=" << usage.userTime << "s, sys=" << usage.sysTime << "s\n"
+               << "Page faults: minor=" << usage.minorFaults
+               << ", major=" << usage.majorFaults << '\n'
+               << "Context switches: voluntary=" << usage.voluntarySwitches
+               << ", involuntary=" << usage.involuntarySwitches << '\n';
 }
 
 PerfStat::MemInfo PerfStat::getMemInMegabytes() const {
@@ -81,31 +298,126 @@ PerfStat::MemInfo PerfStat::getMemInMegabytes() const {
         .rss = info.resident_size / (1024 * 1024),
     };
 #else
-    // Linux: read from /proc/self/status
-    constexpr const char* statusFileName = "/proc/self/status";
-    std::ifstream statusFile(statusFileName);
-    bioassert(statusFile.is_open(), "Failed to open {}", statusFileName);
-
-    std::string str;
-    size_t reserved = 0;
-    while (statusFile >> str) {
-        if (str == "VmSize:") {
-            statusFile >> str;
-            bioassert(!str.empty(), "VmSize empty");
-            const size_t memKB = std::stoull(str);
-            reserved = memKB / 1024;
-        } else if (str == "VmRSS:") {
-            statusFile >> str;
-            bioassert(!str.empty(), "VmRSS empty");
-            const size_t memKB = std::stoull(str);
-            return {
-                .reserved = reserved,
-                .rss = memKB / 1024,
-            };
+    // Linux: /proc/self/statm holds the sizes in pages, the first two
+    // fields are the total program size and the resident set size
+    char buffer[128];
+    const ssize_t bytesRead = pread(_statmFd, buffer, sizeof(buffer) - 1, 0);
+    bioassert(bytesRead > 0, "Failed to read /proc/self/statm");
+    buffer[bytesRead] = '\0';
+
+    char* end = nullptr;
+    const size_t sizePages = strtoull(buffer, &end, 10);
+    const size_t rssPages = strtoull(end, nullptr, 10);
+
+    return {
+        .reserved = sizePages * _pageSize / (1024 * 1024),
+        .rss = rssPages * _pageSize / (1024 * 1024),
+    };
+#endif
+}
+
+PerfStat::ResourceUsage PerfStat::getUsage(int who) {
+    rusage usage {};
+    getrusage(who, &usage);
+
+#ifdef __APPLE__
+    // ru_maxrss is in bytes on macOS
+    const size_t peakRss = usage.ru_maxrss / (1024 * 1024);
+#else
+    // ru_maxrss is in kilobytes on Linux (VmHWM)
+    const size_t peakRss = usage.ru_maxrss / 1024;
+#endif
+
+    const auto toSeconds = [](const timeval& time) {
+        return (double)time.tv_sec + (double)time.tv_usec / 1e6;
+    };
+
+    return {
+        .peakRss = peakRss,
+        .userTime = toSeconds(usage.ru_utime),
+        .sysTime = toSeconds(usage.ru_stime),
+        .minorFaults = (size_t)usage.ru_minflt,
+        .majorFaults = (size_t)usage.ru_majflt,
+        .voluntarySwitches = (size_t)usage.ru_nvcsw,
+        .involuntarySwitches = (size_t)usage.ru_nivcsw,
+    };
+}
+
+PerfStat::ResourceUsage PerfStat::getResourceUsage() {
+    return getUsage(RUSAGE_SELF);
+}
+
+PerfStat::ResourceUsage PerfStat::getThreadResourceUsage() {
+#ifdef RUSAGE_THREAD
+    return getUsage(RUSAGE_THREAD);
+#else
+    return getUsage(RUSAGE_SELF);
+#endif
+}
+
+bool PerfStat::getIoUsage(IoUsage& usage) const {
+    const int fd = _threadIo ? threadIoFile.get() : _ioFd;
+    if (fd < 0) {
+        return false;
+    }
+
+    char buffer[512];
+    const ssize_t bytesRead = pread(fd, buffer, sizeof(buffer) - 1, 0);
+    if (bytesRead <= 0) {
+        return false;
+    }
+
+    buffer[bytesRead] = '\0';
+
+    // Lines are "name: value", in the order of the IoUsage fields
+    uint64_t* fields[] = {
+        &usage.rchar,
+        &usage.wchar,
+        &usage.readSyscalls,
+        &usage.writeSyscalls,
+        &usage.readBytes,
+        &usage.writeBytes,
+    };
+
+    const char* cur = buffer;
+    for (uint64_t* field : fields) {
+        cur = strchr(cur, ':');
+        if (!cur) {
+            return false;
         }
+
+        char* end = nullptr;
+        *field = strtoull(cur + 1, &end, 10);
+        cur = end;
     }
 
-    bioassert(false, "Unreachable code");
-    return {};
-#endif
+    return true;
+}
+
+PerfStat::IoUsage PerfStat::diffIoUsage(const IoUsage& end, const IoUsage& start) {
+    return {
+        .rchar = end.rchar - start.rchar,
+        .wchar = end.wchar - start.wchar,
+        .readSyscalls = end.readSyscalls - start.readSyscalls,
+        .writeSyscalls = end.writeSyscalls - start.writeSyscalls,
+        .readBytes = end.readBytes - start.readBytes,
+        .writeBytes = end.writeBytes - start.writeBytes,
+    };
+}
+
+std::string PerfStat::formatIoUsage(const IoUsage& usage, float seconds) {
+    constexpr double megabyte = 1024.0 * 1024.0;
+
+    const auto throughput = [&](uint64_t bytes) {
+        return seconds > 0.0f ? (double)bytes / megabyte / seconds : 0.0;
+    };
+
+    return fmt::format("[rchar={:.2f}MB ({:.2f}MB/s), wchar={:.2f}MB ({:.2f}MB/s), "
+                       "disk read={:.2f}MB ({:.2f}MB/s), disk write={:.2f}MB ({:.2f}MB/s), "
+                       "syscr={}, syscw={}]",
+                       (double)usage.rchar / megabyte, throughput(usage.rchar),
+                       (double)usage.wchar / megabyte, throughput(usage.wchar),
+                       (double)usage.readBytes / megabyte, throughput(usage.readBytes),
+                       (double)usage.writeBytes / megabyte, throughput(usage.writeBytes),
+                       usage.readSyscalls, usage.writeSyscalls);
 }
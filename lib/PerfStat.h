@@ -1,10 +1,18 @@
 #pragma once
 
+#include <chrono>
 #include <filesystem>
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <vector>
+
+#include "AllocTracker.h"
 
 class TimerStat;
+class ResourceSampler;
 
 class PerfStat {
 public:
@@ -13,23 +21,140 @@ public:
     friend TimerStat;
 
     PerfStat();
+    ~PerfStat();
 
-    static void init(const Path& logFile);
+    // If samplingInterval is non-zero (or TURING_PERF_SAMPLING_MS is set),
+    // a ResourceSampler thread writes a time-series of the process resources
+    // next to logFile, with the .samples.jsonl extension
+    static void init(const Path& logFile,
+                     std::chrono::milliseconds samplingInterval = std::chrono::milliseconds(0));
     static PerfStat* getInstance();
     static void destroy();
 
+    // TimerStat phases are aggregated per call path and reported as a tree
+    // by destroy. Event lines additionally write one line per finished
+    // TimerStat, as soon as it is destroyed. May be called before init,
+    // the setting then applies to the next instance.
+    static void setEventLines(bool enabled);
+
 private:
     std::ofstream _outStream;
+    std::unique_ptr<ResourceSampler> _sampler;
     static PerfStat* _instance;
 
+    // Distinguishes the successive instances, so that the phases of a
+    // TimerStat that outlived destroy are not applied to the next instance
+    static uint64_t _lastGeneration;
+    uint64_t _generation {0};
+
+    // Counters of /proc/thread-self/io or /proc/self/io. rchar and wchar count the bytes passed to
+    // read and write syscalls, readBytes and writeBytes the bytes actually
+    // fetched from or sent to the storage layer
+    struct IoUsage {
+        uint64_t rchar {0};
+        uint64_t wchar {0};
+        uint64_t readSyscalls {0};
+        uint64_t writeSyscalls {0};
+        uint64_t readBytes {0};
+        uint64_t writeBytes {0};
+    };
+
+    // Aggregated TimerStat phases, the node 0 is the root
+    struct Phase {
+        std::string name;
+        size_t parent {0};
+        std::vector<size_t> children;
+        size_t count {0};
+        float total {0.0f};
+        float min {0.0f};
+        float max {0.0f};
+        double userTime {0.0};
+        double sysTime {0.0};
+        size_t minorFaults {0};
+        size_t majorFaults {0};
+        size_t voluntarySwitches {0};
+        size_t involuntarySwitches {0};
+
+        // Highest peak RSS of the process seen at the end of the phase, in MB
+        size_t peakRss {0};
+
+        uint64_t allocCount {0};
+        uint64_t allocBytes {0};
+        uint64_t freedBytes {0};
+        uint64_t peakAllocBytes {0};
+        IoUsage io;
+    };
+
+    // Measures of one finished TimerStat
+    struct PhaseSample {
+        float seconds {0.0f};
+        double userTime {0.0};
+        double sysTime {0.0};
+        size_t minorFaults {0};
+        size_t majorFaults {0};
+        size_t voluntarySwitches {0};
+        size_t involuntarySwitches {0};
+        size_t peakRss {0};
+        AllocTracker::Delta allocs;
+        IoUsage io;
+    };
+
+    std::mutex _mutex;
+    std::vector<Phase> _phases {1};
+    bool _eventLines {false};
+
+    // Last value given to setEventLines, applied by init
+    static bool _defaultEventLines;
+
+    size_t enterPhase(size_t parent, std::string_view name);
+    void leavePhase(size_t phase, const PhaseSample& sample);
+    void reportPhases();
+    void reportPhase(size_t phase, size_t depth);
+
     void open(const Path& logFile);
+    void startSampler(const Path& logFile, std::chrono::milliseconds samplingInterval);
     void close();
     void reportTotalMem();
 
+    // Persistent descriptors on /proc/self/statm and /proc/self/io, read with pread
+    int _statmFd {-1};
+    int _ioFd {-1};
+
+    // Whether the I/O is read per thread from /proc/thread-self/io,
+    // rather than for the whole process from _ioFd
+    bool _threadIo {false};
+    size_t _pageSize {0};
+
     struct MemInfo {
         size_t reserved {0};
         size_t rss {0};
     };
 
+    // Counters from getrusage, times are in seconds
+    struct ResourceUsage {
+        size_t peakRss {0};
+        double userTime {0.0};
+        double sysTime {0.0};
+        size_t minorFaults {0};
+        size_t majorFaults {0};
+        size_t voluntarySwitches {0};
+        size_t involuntarySwitches {0};
+    };
+
     MemInfo getMemInMegabytes() const;
+    static ResourceUsage getUsage(int who);
+
+    // Process-wide usage, for the peak RSS and the exit report
+    static ResourceUsage getResourceUsage();
+
+    // Usage of the calling thread (RUSAGE_THREAD), so that nested scopes
+    // are not charged for the other threads. Process-wide where RUSAGE_THREAD
+    // is not available. peakRss stays process-wide
+    static ResourceUsage getThreadResourceUsage();
+
+    // I/O of the calling thread where /proc/thread-self/io is available,
+    // of the process otherwise. Returns false if neither is (macOS, some containers)
+    bool getIoUsage(IoUsage& usage) const;
+    static IoUsage diffIoUsage(const IoUsage& end, const IoUsage& start);
+    static std::string formatIoUsage(const IoUsage& usage, float seconds);
 };
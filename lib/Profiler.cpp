@@ -1,102 +1,621 @@
 #include "Profiler.h"
 
 #include <algorithm>
-#include <map>
+#include <array>
+#include <iterator>
+#include <memory>
 #include <mutex>
-#include <unordered_map>
+#include <signal.h>
+#include <stdlib.h>
 #include <vector>
 
 #include <spdlog/fmt/bundled/core.h>
 
+#include "AllocTracker.h"
+#include "PerfCounters.h"
 #include "TuringTime.h"
 
-struct ProfileData {
-    Profiler::ProfileID _id;
+namespace {
+
+// Returned for scopes dropped by sampling
+constexpr Profiler::ProfileID SKIPPED_ID = UINT64_MAX - 1;
+
+// Log-linear histogram of durations in nanoseconds, 8 buckets per power of two.
+// Percentiles are reported at the bucket midpoint, within 6.25 % of the samples.
+class DurationHistogram {
+public:
+    static constexpr size_t SUB_BITS = 3;
+    static constexpr size_t SUB_COUNT = 1ull << SUB_BITS;
+    static constexpr size_t MAX_EXP = 42;
+    static constexpr size_t BUCKET_COUNT = 2 * SUB_COUNT + (MAX_EXP - SUB_BITS) * SUB_COUNT;
+
+    void record(float us) {
+        _buckets[getBucket(us)]++;
+    }
+
+    void merge(const DurationHistogram& other) {
+        for (size_t i = 0; i < BUCKET_COUNT; i++) {
+            _buckets[i] += other._buckets[i];
+        }
+    }
+
+    void reset() {
+        _buckets.fill(0);
+    }
+
+    float percentile(float p, size_t count) const {
+        const size_t rank = std::max<size_t>(1, (size_t)(p * (float)count + 0.5f));
+        size_t seen = 0;
+        for (size_t i = 0; i < BUCKET_COUNT; i++) {
+            seen += _buckets[i];
+            if (seen >= rank) {
+                return getMidpoint(i) / 1000.0f;
+            }
+        }
+
+        return 0.0f;
+    }
+
+private:
+    std::array<uint64_t, BUCKET_COUNT> _buckets {};
+
+    static size_t getBucket(float us) {
+        constexpr uint64_t maxValue = (1ull << (MAX_EXP + 1)) - 1;
+        const uint64_t ns = std::min<uint64_t>((uint64_t)std::max(us * 1000.0f, 0.0f), maxValue);
+        if (ns < 2 * SUB_COUNT) {
+            return ns;
+        }
+
+        const size_t exp = 63 - __builtin_clzll(ns);
+        const size_t sub = (ns >> (exp - SUB_BITS)) & (SUB_COUNT - 1);
+        return 2 * SUB_COUNT + (exp - SUB_BITS - 1) * SUB_COUNT + sub;
+    }
+
+    static float getMidpoint(size_t bucket) {
+        if (bucket < 2 * SUB_COUNT) {
+            return (float)bucket;
+        }
+
+        const size_t index = bucket - 2 * SUB_COUNT;
+        const size_t exp = index / SUB_COUNT + SUB_BITS + 1;
+        const size_t sub = index % SUB_COUNT;
+        const uint64_t width = 1ull << (exp - SUB_BITS);
+        return (float)((SUB_COUNT + sub) * width) + (float)width / 2.0f;
+    }
+};
+
+// Fixed-size statistics of one call path. Durations are in microseconds
+struct ProfileStats {
+    size_t _count {0};
+    double _total {0.0};
+    double _self {0.0};
+    float _min {0.0f};
+    float _max {0.0f};
+    DurationHistogram _histogram;
+
+    // Hardware counter totals over the _counterCount calls that were measured
+    PerfCounters::Values _counters {};
+    size_t _counterCount {0};
+    uint32_t _counterMask {0};
+
+    // Heap activity, only recorded with TURING_ALLOC_TRACKING
+    uint64_t _allocCount {0};
+    uint64_t _allocBytes {0};
+    uint64_t _freedBytes {0};
+    uint64_t _peakAllocBytes {0};
+
+    void record(float dur, float self) {
+        _min = _count == 0 ? dur : std::min(_min, dur);
+        _max = std::max(_max, dur);
+        _count++;
+        _total += dur;
+        _self += self;
+        _histogram.record(dur);
+    }
+
+    void recordCounters(const PerfCounters::Values& start,
+                        const PerfCounters::Values& end,
+                        uint32_t mask) {
+        for (size_t i = 0; i < PerfCounters::EventCount; i++) {
+            _counters[i] += end[i] - start[i];
+        }
+
+        _counterCount++;
+        _counterMask |= mask;
+    }
+
+    void recordAllocs(const AllocTracker::Delta& allocs) {
+        _allocCount += allocs.allocCount;
+        _allocBytes += allocs.allocBytes;
+        _freedBytes += allocs.freedBytes;
+        _peakAllocBytes = std::max(_peakAllocBytes, allocs.peakBytes);
+    }
+
+    void merge(const ProfileStats& other) {
+        if (other._count != 0) {
+            _min = _count == 0 ? other._min : std::min(_min, other._min);
+            _max = std::max(_max, other._max);
+        }
+
+        _count += other._count;
+        _total += other._total;
+        _self += other._self;
+        _histogram.merge(other._histogram);
+
+        for (size_t i = 0; i < PerfCounters::EventCount; i++) {
+            _counters[i] += other._counters[i];
+        }
+
+        _counterCount += other._counterCount;
+        _counterMask |= other._counterMask;
+
+        _allocCount += other._allocCount;
+        _allocBytes += other._allocBytes;
+        _freedBytes += other._freedBytes;
+        _peakAllocBytes = std::max(_peakAllocBytes, other._peakAllocBytes);
+    }
+
+    void reset() {
+        *this = ProfileStats();
+    }
+
+    float percentile(float p) const {
+        return std::clamp(_histogram.percentile(p, _count), _min, _max);
+    }
+};
+
+// Statistics since the start (or the last clear) and since the last dumpInterval
+struct ProfileNode {
     std::string_view _message;
+    size_t _parent {0};
+    std::vector<size_t> _children;
+    bool _running {false};
+    ProfileStats _stats;
+    ProfileStats _interval;
+};
+
+using StatsMember = ProfileStats ProfileNode::*;
+
+// Call tree indexed by node position, node 0 is the root and is never timed
+class CallTree {
+public:
+    CallTree()
+        : _nodes(1)
+    {
+    }
+
+    size_t getChild(size_t parent, std::string_view message) {
+        for (const size_t child : _nodes[parent]._children) {
+            if (_nodes[child]._message == message) {
+                return child;
+            }
+        }
+
+        const size_t child = _nodes.size();
+        _nodes.emplace_back();
+        _nodes[child]._message = message;
+        _nodes[child]._parent = parent;
+        _nodes[parent]._children.push_back(child);
+        return child;
+    }
+
+    ProfileNode& operator[](size_t node) { return _nodes[node]; }
+    const ProfileNode& operator[](size_t node) const { return _nodes[node]; }
+
+    // Merges the src statistics of the subtree of other rooted at otherNode
+    // into the dst statistics of node, by call path
+    void merge(size_t node,
+               const CallTree& other,
+               size_t otherNode,
+               StatsMember src,
+               StatsMember dst) {
+        for (const size_t otherChild : other[otherNode]._children) {
+            const size_t child = getChild(node, other[otherChild]._message);
+            (_nodes[child].*dst).merge(other[otherChild].*src);
+            _nodes[child]._running |= other[otherChild]._running;
+            merge(child, other, otherChild, src, dst);
+        }
+    }
+
+    void reset(StatsMember stats) {
+        for (auto& node : _nodes) {
+            (node.*stats).reset();
+        }
+    }
+
+private:
+    std::vector<ProfileNode> _nodes;
+};
+
+struct ProfileFrame {
+    size_t _node {0};
     TimePoint _startTime;
-    TimePoint _endTime;
-    bool _finished = false;
-    size_t _nesting = 0;
+    float _childTime {0.0f};
+    bool _counted {false};
+    PerfCounters::Values _startCounters;
+    AllocTracker::Scope _allocScope;
 };
 
-class ProfilerInstance {
+// Call tree of a single thread. The mutex is only contended during dump and clear
+class ThreadProfile {
 public:
-    Profiler::ProfileID start(std::string_view message) {
+    Profiler::ProfileID start(std::string_view message,
+                              uint32_t samplingRate,
+                              bool countersEnabled) {
+        // Nested scopes of a skipped top-level scope are skipped too,
+        // _skipDepth is only accessed by the owning thread
+        if (_skipDepth != 0) {
+            _skipDepth++;
+            return SKIPPED_ID;
+        }
+
+        if (_stack.empty() && samplingRate > 1 && _sampleCounter++ % samplingRate != 0) {
+            _skipDepth = 1;
+            return SKIPPED_ID;
+        }
+
         std::scoped_lock guard(_mutex);
-        _profilers[_nextID] = ProfileData {
-            ._id = _nextID,
-            ._message = message,
-            ._startTime = Clock::now(),
-            ._nesting = _nesting++,
-        };
+        const size_t parent = _stack.empty() ? 0 : _stack.back()._node;
+        const size_t node = _tree.getChild(parent, message);
+        ProfileFrame& frame = _stack.emplace_back();
+        frame._node = node;
+        frame._startTime = Clock::now();
 
-        return _nextID++;
+        if constexpr (AllocTracker::enabled) {
+            AllocTracker::beginScope(frame._allocScope);
+        }
+
+        if (countersEnabled) {
+            frame._counted = getCounters().read(frame._startCounters);
+        }
+
+        return _stack.size();
     }
 
     void stop(Profiler::ProfileID id) {
+        if (id == SKIPPED_ID) {
+            _skipDepth -= _skipDepth != 0;
+            return;
+        }
+
+        // Only the owning thread pushes and pops _stack, the counters are
+        // read for a balanced stop of a counted scope only
+        PerfCounters::Values endCounters;
+        const bool counted = _counters
+                          && !_stack.empty()
+                          && id == _stack.size()
+                          && _stack.back()._counted
+                          && _counters->read(endCounters);
+        const TimePoint endTime = Clock::now();
         std::scoped_lock guard(_mutex);
-        const auto profile = _profilers.find(id);
 
-        if (profile == _profilers.end()) {
+        // Scopes are strictly nested on a thread, ignore unbalanced stops
+        if (_stack.empty() || id != _stack.size()) {
             return;
         }
 
-        profile->second._endTime = Clock::now();
-        profile->second._finished = true;
-        _nesting--;
+        const ProfileFrame frame = _stack.back();
+        _stack.pop_back();
+
+        if constexpr (AllocTracker::enabled) {
+            const AllocTracker::Delta allocs = AllocTracker::endScope(frame._allocScope);
+            _tree[frame._node]._stats.recordAllocs(allocs);
+            _tree[frame._node]._interval.recordAllocs(allocs);
+        }
+
+        const float dur = duration<Microseconds>(frame._startTime, endTime);
+        ProfileNode& node = _tree[frame._node];
+        node._stats.record(dur, dur - frame._childTime);
+        node._interval.record(dur, dur - frame._childTime);
+
+        if (frame._counted && counted) {
+            const uint32_t mask = _counters->getAvailableMask();
+            node._stats.recordCounters(frame._startCounters, endCounters, mask);
+            node._interval.recordCounters(frame._startCounters, endCounters, mask);
+        }
+
+        if (!_stack.empty()) {
+            _stack.back()._childTime += dur;
+        }
     }
 
-    void dump(std::string& out) {
+    // Merges the src statistics into the _stats of merged,
+    // the interval statistics are restarted if resetInterval is set
+    void mergeInto(CallTree& merged, StatsMember src, bool resetInterval) {
         std::scoped_lock guard(_mutex);
-        _timings.clear();
+        for (const auto& frame : _stack) {
+            _tree[frame._node]._running = true;
+        }
 
-        for (auto& [id, profile] : _profilers) {
-            if (!profile._finished) {
-                out += fmt::format("{1:>{0}} [{2}]: running\n", profile._nesting * 2, ' ', profile._message);
-                continue;
-            }
+        merged.merge(0, _tree, 0, src, &ProfileNode::_stats);
 
-            const auto dur = duration<Microseconds>(profile._startTime, profile._endTime);
-            _timings[profile._message] += dur;
+        for (const auto& frame : _stack) {
+            _tree[frame._node]._running = false;
         }
 
-        _timingsSorted.resize(_timings.size());
+        if (resetInterval) {
+            _tree.reset(&ProfileNode::_interval);
+        }
+    }
 
-        size_t i = 0;
-        float maxProfiled = 0.0f;
-        for (auto& [message, dur] : _timings) {
-            _timingsSorted[i++] = {message, dur};
-            maxProfiled = std::max(maxProfiled, dur);
+    // Merges both statistics of the finished thread into retired
+    void retireInto(CallTree& retired) {
+        std::scoped_lock guard(_mutex);
+        retired.merge(0, _tree, 0, &ProfileNode::_stats, &ProfileNode::_stats);
+        retired.merge(0, _tree, 0, &ProfileNode::_interval, &ProfileNode::_interval);
+    }
+
+    void clear() {
+        std::scoped_lock guard(_mutex);
+        _tree.reset(&ProfileNode::_stats);
+        _tree.reset(&ProfileNode::_interval);
+    }
+
+    bool hasCounters() {
+        return getCounters().isAvailable();
+    }
+
+private:
+    std::mutex _mutex;
+    CallTree _tree;
+    std::vector<ProfileFrame> _stack;
+    size_t _skipDepth {0};
+    uint32_t _sampleCounter {0};
+    std::unique_ptr<PerfCounters> _counters;
+
+    PerfCounters& getCounters() {
+        if (!_counters) {
+            _counters = std::make_unique<PerfCounters>();
         }
 
-        std::sort(_timingsSorted.begin(), _timingsSorted.end(), [](auto& a, auto& b) {
-            return a.second < b.second;
-        });
+        return *_counters;
+    }
+};
 
-        for (auto& [message, dur] : _timingsSorted) {
-            if (dur < 1000.0f) {
-                out += fmt::format("[{}]: {:.3f} us ({:.2f} %)\n", message, dur, dur / maxProfiled * 100.0f);
-            } else if (dur < 1000.0f * 1000.0f) {
-                out += fmt::format("[{}]: {:.3f} ms ({:.2f} %)\n", message, dur / 1000.0f, dur / maxProfiled * 100.0f);
-            } else {
-                out += fmt::format("[{}]: {:.3f} s ({:.2f} %)\n", message, dur / 1000.0f / 1000.0f, dur / maxProfiled * 100.0f);
-            }
+void appendDuration(std::string& out, double us) {
+    if (us < 1000.0) {
+        fmt::format_to(std::back_inserter(out), "{:.3f} us", us);
+    } else if (us < 1000.0 * 1000.0) {
+        fmt::format_to(std::back_inserter(out), "{:.3f} ms", us / 1000.0);
+    } else {
+        fmt::format_to(std::back_inserter(out), "{:.3f} s", us / 1000.0 / 1000.0);
+    }
+}
+
+void appendAllocs(std::string& out, const ProfileStats& stats) {
+    if constexpr (AllocTracker::enabled) {
+        fmt::format_to(std::back_inserter(out),
+                       ", allocs/call: {:.1f}, allocated: {} B, freed: {} B, peak: {} B",
+                       (double)stats._allocCount / (double)stats._count,
+                       stats._allocBytes,
+                       stats._freedBytes,
+                       stats._peakAllocBytes);
+    }
+}
+
+void appendCounters(std::string& out, const ProfileStats& node) {
+    using Event = PerfCounters::Event;
+
+    if (node._counterCount == 0 || node._counterMask == 0) {
+        return;
+    }
+
+    const auto has = [&](Event event) {
+        return (node._counterMask & (1u << (size_t)event)) != 0;
+    };
+
+    const auto get = [&](Event event) {
+        return (double)node._counters[(size_t)event];
+    };
+
+    if (has(Event::Cycles) && has(Event::Instructions) && get(Event::Cycles) > 0.0) {
+        fmt::format_to(std::back_inserter(out), ", IPC: {:.2f}",
+                       get(Event::Instructions) / get(Event::Cycles));
+    }
+
+    for (const Event event : {Event::L1DMisses, Event::LLCMisses,
+                              Event::BranchMisses, Event::DTLBMisses}) {
+        if (has(event)) {
+            fmt::format_to(std::back_inserter(out), ", {}/call: {:.1f}",
+                           PerfCounters::getName(event),
+                           get(event) / (double)node._counterCount);
+        }
+    }
+}
+
+}
+
+class ProfilerInstance {
+public:
+    ProfilerInstance() {
+        const char* enabled = getenv("TURING_PROFILE");
+        if (enabled && atoi(enabled) != 0) {
+            Profiler::setEnabled(true);
+        }
+
+        const char* samplingRate = getenv("TURING_PROFILE_SAMPLING");
+        if (samplingRate) {
+            _samplingRate = strtoul(samplingRate, nullptr, 10);
+        }
+
+        const char* counters = getenv("TURING_PROFILE_COUNTERS");
+        if (counters && atoi(counters) != 0) {
+            _countersEnabled = true;
+        }
+    }
+
+    Profiler::ProfileID start(std::string_view message) {
+        const uint32_t samplingRate = _samplingRate.load(std::memory_order_relaxed);
+        const bool countersEnabled = _countersEnabled.load(std::memory_order_relaxed);
+        return getThreadProfile().start(message, samplingRate, countersEnabled);
+    }
+
+    void stop(Profiler::ProfileID id) {
+        getThreadProfile().stop(id);
+    }
+
+    void dump(std::string& out) {
+        CallTree merged;
+
+        {
+            std::scoped_lock guard(_mutex);
+            mergeThreads(merged, &ProfileNode::_stats, false);
         }
+
+        dumpTree(out, merged);
+    }
+
+    void dumpInterval(std::string& out) {
+        CallTree merged;
+        TimePoint intervalStart;
+        const TimePoint intervalEnd = Clock::now();
+
+        {
+            std::scoped_lock guard(_mutex);
+            mergeThreads(merged, &ProfileNode::_interval, true);
+            intervalStart = _intervalStart;
+            _intervalStart = intervalEnd;
+        }
+
+        out += "Interval: ";
+        appendDuration(out, duration<Microseconds>(intervalStart, intervalEnd));
+        out += '\n';
+
+        dumpTree(out, merged);
     }
 
     void clear() {
         std::scoped_lock guard(_mutex);
-        _nesting = 0;
-        _profilers.clear();
+        for (const auto& thread : _threads) {
+            thread->clear();
+        }
+
+        _retired = CallTree();
+        _intervalStart = Clock::now();
+    }
+
+    void setSamplingRate(uint32_t rate) {
+        _samplingRate.store(rate, std::memory_order_relaxed);
+    }
+
+    uint32_t getSamplingRate() const {
+        return _samplingRate.load(std::memory_order_relaxed);
+    }
+
+    bool setHardwareCounters(bool enabled) {
+        if (enabled && !getThreadProfile().hasCounters()) {
+            return false;
+        }
+
+        _countersEnabled.store(enabled, std::memory_order_relaxed);
+        return true;
     }
 
 private:
-    mutable std::mutex _mutex;
-    Profiler::ProfileID _nextID = 0;
-    size_t _nesting {0};
-    std::map<Profiler::ProfileID, ProfileData> _profilers;
-    std::unordered_map<std::string_view, float> _timings;
-    std::vector<std::pair<std::string_view, float>> _timingsSorted;
+    std::mutex _mutex;
+    std::atomic<uint32_t> _samplingRate {0};
+    std::atomic<bool> _countersEnabled {false};
+    std::vector<ThreadProfile*> _threads;
+    TimePoint _intervalStart {Clock::now()};
+
+    // Call trees of the threads that have exited
+    CallTree _retired;
+
+    // Folds the tree of the thread into _retired when it exits,
+    // so that thread churn does not grow the profiler
+    class ThreadProfileHolder {
+    public:
+        explicit ThreadProfileHolder(ProfilerInstance& instance)
+            : _instance(instance)
+        {
+            std::scoped_lock guard(_instance._mutex);
+            _instance._threads.push_back(&_threadProfile);
+        }
+
+        ~ThreadProfileHolder() {
+            std::scoped_lock guard(_instance._mutex);
+            _threadProfile.retireInto(_instance._retired);
+            std::erase(_instance._threads, &_threadProfile);
+        }
+
+        ThreadProfile& get() { return _threadProfile; }
+
+    private:
+        ProfilerInstance& _instance;
+        ThreadProfile _threadProfile;
+    };
+
+    ThreadProfile& getThreadProfile() {
+        thread_local ThreadProfileHolder holder(*this);
+        return holder.get();
+    }
+
+    void mergeThreads(CallTree& merged, StatsMember src, bool resetInterval) {
+        merged.merge(0, _retired, 0, src, &ProfileNode::_stats);
+        if (resetInterval) {
+            _retired.reset(&ProfileNode::_interval);
+        }
+
+        for (ThreadProfile* thread : _threads) {
+            thread->mergeInto(merged, src, resetInterval);
+        }
+    }
+
+    void dumpTree(std::string& out, CallTree& merged) {
+        double maxProfiled = 0.0;
+        for (const size_t child : merged[0]._children) {
+            maxProfiled = std::max(maxProfiled, merged[child]._stats._total);
+        }
+
+        dumpNode(out, merged, 0, 0, maxProfiled);
+    }
+
+    void dumpNode(std::string& out,
+                  CallTree& tree,
+                  size_t node,
+                  size_t depth,
+                  double maxProfiled) {
+        std::vector<size_t> children = tree[node]._children;
+        std::sort(children.begin(), children.end(), [&](size_t a, size_t b) {
+            return tree[a]._stats._total > tree[b]._stats._total;
+        });
+
+        for (const size_t child : children) {
+            const ProfileNode& data = tree[child];
+            const ProfileStats& stats = data._stats;
+
+            if (stats._count == 0) {
+                if (data._running) {
+                    out.append(depth * 2, ' ');
+                    fmt::format_to(std::back_inserter(out), "[{}]: running\n", data._message);
+                    dumpNode(out, tree, child, depth + 1, maxProfiled);
+                }
+                continue;
+            }
+
+            out.append(depth * 2, ' ');
+            fmt::format_to(std::back_inserter(out), "[{}]: ", data._message);
+            appendDuration(out, stats._total);
+            fmt::format_to(std::back_inserter(out), " ({:.2f} %), self: ",
+                           maxProfiled > 0.0 ? stats._total / maxProfiled * 100.0 : 0.0);
+            appendDuration(out, stats._self);
+            fmt::format_to(std::back_inserter(out), ", calls: {}, min: ", stats._count);
+            appendDuration(out, stats._min);
+            out += ", max: ";
+            appendDuration(out, stats._max);
+            out += ", p50: ";
+            appendDuration(out, stats.percentile(0.50f));
+            out += ", p90: ";
+            appendDuration(out, stats.percentile(0.90f));
+            out += ", p99: ";
+            appendDuration(out, stats.percentile(0.99f));
+            appendCounters(out, stats);
+            appendAllocs(out, stats);
+            out += data._running ? " (running)\n" : "\n";
+
+            dumpNode(out, tree, child, depth + 1, maxProfiled);
+        }
+    }
 };
 
 static ProfilerInstance _instance;
@@ -116,3 +635,33 @@ void Profiler::dumpImpl(std::string& out) {
 void Profiler::clearImpl() {
     _instance.clear();
 }
+
+void Profiler::setSamplingRate(uint32_t rate) {
+    _instance.setSamplingRate(rate);
+}
+
+uint32_t Profiler::getSamplingRate() {
+    return _instance.getSamplingRate();
+}
+
+void Profiler::dumpInterval(std::string& out) {
+    _instance.dumpInterval(out);
+}
+
+bool Profiler::setHardwareCounters(bool enabled) {
+    return _instance.setHardwareCounters(enabled);
+}
+
+bool Profiler::installSignalHandler(int signum) {
+    struct sigaction action {};
+    action.sa_handler = toggleHandler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    return sigaction(signum, &action, nullptr) == 0;
+}
+
+void Profiler::toggleHandler(int) {
+    // Lock-free atomics are async-signal-safe
+    _enabled.store(!_enabled.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
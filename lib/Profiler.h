@@ -4,43 +4,43 @@
 #define TURING_PROFILE false
 #endif
 
+#include <atomic>
+#include <string>
 #include <string_view>
 #include <stdint.h>
 
+// Profiling is always compiled in and switched at runtime, TURING_PROFILE
+// only sets the initial state. It can also be enabled by setting the
+// TURING_PROFILE environment variable to 1 or through installSignalHandler.
+// A disabled Profile scope costs a relaxed load and a branch.
 class Profiler {
 public:
     using ProfileID = uint64_t;
 
     static ProfileID start(std::string_view message) {
-        if constexpr (!_profiling) {
+        if (!isEnabled()) {
+            [[likely]]
             return 0;
-        } else {
-            return startImpl(message);
         }
+
+        return startImpl(message);
     }
 
     static void stop(ProfileID id) {
-        if constexpr (!_profiling) {
+        // Scopes started while profiling was disabled have the id 0
+        if (id == 0) {
             return;
-        } else {
-            stopImpl(id);
         }
+
+        stopImpl(id);
     }
 
     static void dump(std::string& out) {
-        if constexpr (!_profiling) {
-            return;
-        } else {
-            dumpImpl(out);
-        }
+        dumpImpl(out);
     }
 
     static void clear() {
-        if constexpr (!_profiling) {
-            return;
-        } else {
-            clearImpl();
-        }
+        clearImpl();
     }
 
     static void dumpAndClear(std::string& out) {
@@ -48,13 +48,41 @@ public:
         clear();
     }
 
+    // Dumps the scopes finished since the previous call (or since clear),
+    // for periodic reporting in long-running processes
+    static void dumpInterval(std::string& out);
+
+    static bool isEnabled() {
+        return _enabled.load(std::memory_order_relaxed);
+    }
+
+    static void setEnabled(bool enabled) {
+        _enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    // Records only one top-level scope (and its nested scopes)
+    // out of rate on each thread. A rate of 0 or 1 records everything.
+    // Read from the TURING_PROFILE_SAMPLING environment variable at startup.
+    static void setSamplingRate(uint32_t rate);
+    static uint32_t getSamplingRate();
+
+    // Reads hardware performance counters (cycles, instructions, cache,
+    // branch and dTLB misses) at the begin and end of each scope.
+    // Returns false if the counters can not be opened on this system.
+    // Read from the TURING_PROFILE_COUNTERS environment variable at startup.
+    static bool setHardwareCounters(bool enabled);
+
+    // Toggles profiling each time signum is received
+    static bool installSignalHandler(int signum);
+
 private:
-    static constexpr bool _profiling = TURING_PROFILE;
+    static inline std::atomic<bool> _enabled {TURING_PROFILE};
 
     static ProfileID startImpl(std::string_view message);
     static void stopImpl(ProfileID);
     static void dumpImpl(std::string& out);
     static void clearImpl();
+    static void toggleHandler(int signum);
 };
 
 class Profile {
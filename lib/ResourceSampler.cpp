@@ -0,0 +1,310 @@
+#include "ResourceSampler.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <iterator>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <spdlog/fmt/bundled/format.h>
+
+#include "ControlCharacters.h"
+
+namespace {
+
+// Reads a whole /proc file with pread, returns false on error
+bool readProcFile(int fd, std::string& buffer) {
+    buffer.resize(4096);
+    size_t size = 0;
+
+    for (;;) {
+        const ssize_t bytesRead = pread(fd, buffer.data() + size, buffer.size() - size, size);
+        if (bytesRead < 0) {
+            return false;
+        }
+
+        if (bytesRead == 0) {
+            break;
+        }
+
+        size += bytesRead;
+        if (size == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+    }
+
+    buffer.resize(size);
+    return true;
+}
+
+bool readProcFile(const char* path, std::string& buffer) {
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    const bool res = readProcFile(fd, buffer);
+    close(fd);
+    return res;
+}
+
+// Returns utime + stime of a /proc/<pid>/stat content, in clock ticks,
+// and the command name between the parenthesis
+uint64_t parseStatTicks(const std::string& stat, std::string_view* name) {
+    const size_t nameBegin = stat.find('(');
+    const size_t nameEnd = stat.rfind(')');
+    if (nameBegin == std::string::npos || nameEnd == std::string::npos) {
+        return 0;
+    }
+
+    if (name) {
+        *name = std::string_view(stat).substr(nameBegin + 1, nameEnd - nameBegin - 1);
+    }
+
+    // Fields after the name start at field 3 (state), utime is field 14
+    const char* cur = stat.c_str() + nameEnd + 1;
+    for (size_t field = 3; field < 14; field++) {
+        cur = strchr(cur + 1, ' ');
+        if (!cur) {
+            return 0;
+        }
+    }
+
+    char* end = nullptr;
+    const uint64_t utime = strtoull(cur, &end, 10);
+    const uint64_t stime = strtoull(end, nullptr, 10);
+    return utime + stime;
+}
+
+uint64_t parseIoField(const std::string& io, std::string_view field) {
+    const size_t pos = io.find(field);
+    if (pos == std::string::npos) {
+        return 0;
+    }
+
+    return strtoull(io.c_str() + pos + field.size(), nullptr, 10);
+}
+
+// Calls func(tid, ticks, name) with the CPU ticks of each thread of the
+// process, buffer holds the stat content name points to
+template <typename Func>
+bool forEachThread(std::string& buffer, Func func) {
+    DIR* dir = opendir("/proc/self/task");
+    if (!dir) {
+        return false;
+    }
+
+    std::string statPath;
+    while (const dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        statPath = "/proc/self/task/";
+        statPath += entry->d_name;
+        statPath += "/stat";
+        if (!readProcFile(statPath.c_str(), buffer)) {
+            // The thread exited in the meantime
+            continue;
+        }
+
+        std::string_view name;
+        const uint64_t ticks = parseStatTicks(buffer, &name);
+        func(atoi(entry->d_name), ticks, name);
+    }
+
+    closedir(dir);
+    return true;
+}
+
+size_t countOpenFiles() {
+    DIR* dir = opendir("/proc/self/fd");
+    if (!dir) {
+        return 0;
+    }
+
+    size_t count = 0;
+    while (const dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            count++;
+        }
+    }
+
+    closedir(dir);
+
+    // Do not count the descriptor of the directory stream itself
+    return count > 0 ? count - 1 : 0;
+}
+
+}
+
+ResourceSampler::ResourceSampler(const Path& outFile, std::chrono::milliseconds interval)
+    : _outFile(outFile),
+    _interval(interval)
+{
+}
+
+ResourceSampler::~ResourceSampler() {
+    stop();
+}
+
+bool ResourceSampler::start() {
+#ifndef __linux__
+    return false;
+#else
+    if (_thread.joinable() || _interval.count() <= 0) {
+        return false;
+    }
+
+    _statmFd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+    _statFd = open("/proc/self/stat", O_RDONLY | O_CLOEXEC);
+    if (_statmFd < 0 || _statFd < 0) {
+        closeFiles();
+        return false;
+    }
+
+    // /proc/self/io is not readable in some containers, skipped if missing
+    _ioFd = open("/proc/self/io", O_RDONLY | O_CLOEXEC);
+
+    _outStream.open(_outFile);
+    if (!_outStream.is_open()) {
+        closeFiles();
+        return false;
+    }
+
+    _pageSize = sysconf(_SC_PAGESIZE);
+    _ticksPerSecond = (double)sysconf(_SC_CLK_TCK);
+    _startTime = Clock::now();
+    _lastTime = _startTime;
+    _stopRequested = false;
+
+    if (readProcFile(_statFd, _buffer)) {
+        _lastProcessTicks = parseStatTicks(_buffer, nullptr);
+    }
+
+    // Threads alive before start are reported from now on, only the
+    // threads created later start from 0
+    _lastThreadTicks.clear();
+    forEachThread(_buffer, [this](pid_t tid, uint64_t ticks, std::string_view) {
+        _lastThreadTicks[tid] = ticks;
+    });
+
+    _thread = std::thread([this] { run(); });
+    return true;
+#endif
+}
+
+void ResourceSampler::stop() {
+    if (!_thread.joinable()) {
+        return;
+    }
+
+    {
+        std::scoped_lock guard(_mutex);
+        _stopRequested = true;
+    }
+
+    _stopCond.notify_all();
+    _thread.join();
+
+    _outStream.close();
+    closeFiles();
+}
+
+void ResourceSampler::closeFiles() {
+    for (int* fd : {&_statmFd, &_statFd, &_ioFd}) {
+        if (*fd >= 0) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+void ResourceSampler::run() {
+    std::unique_lock lock(_mutex);
+    for (;;) {
+        if (_stopCond.wait_for(lock, _interval, [this] { return _stopRequested; })) {
+            // Last sample so that the end of the run is always reported
+            sample();
+            return;
+        }
+
+        sample();
+    }
+}
+
+void ResourceSampler::sample() {
+    const TimePoint now = Clock::now();
+    const double elapsed = duration<Seconds>(_lastTime, now);
+    _lastTime = now;
+
+    _line.clear();
+    auto out = std::back_inserter(_line);
+    fmt::format_to(out, "{{\"time\":{:.3f}", duration<Seconds>(_startTime, now));
+
+    if (readProcFile(_statmFd, _buffer)) {
+        char* end = nullptr;
+        strtoull(_buffer.c_str(), &end, 10);
+        const size_t rssPages = strtoull(end, nullptr, 10);
+        fmt::format_to(out, ",\"rss_mb\":{}", rssPages * _pageSize / (1024 * 1024));
+    }
+
+    if (readProcFile(_statFd, _buffer)) {
+        const uint64_t ticks = parseStatTicks(_buffer, nullptr);
+        const double cpu = elapsed > 0.0
+                         ? (double)(ticks - _lastProcessTicks) / _ticksPerSecond / elapsed * 100.0
+                         : 0.0;
+        _lastProcessTicks = ticks;
+        fmt::format_to(out, ",\"cpu\":{:.1f}", cpu);
+    }
+
+    fmt::format_to(out, ",\"fds\":{}", countOpenFiles());
+
+    if (_ioFd >= 0 && readProcFile(_ioFd, _buffer)) {
+        fmt::format_to(out, ",\"rchar\":{},\"wchar\":{},\"read_bytes\":{},\"write_bytes\":{}",
+                       parseIoField(_buffer, "rchar: "),
+                       parseIoField(_buffer, "wchar: "),
+                       parseIoField(_buffer, "read_bytes: "),
+                       parseIoField(_buffer, "write_bytes: "));
+    }
+
+    appendThreads(elapsed);
+    _line += "}\n";
+
+    _outStream << _line;
+    _outStream.flush();
+}
+
+void ResourceSampler::appendThreads(double elapsed) {
+    const size_t begin = _line.size();
+    _line += ",\"threads\":[";
+    _threadTicks.clear();
+
+    std::string escapedName;
+    bool first = true;
+    const bool listed = forEachThread(_buffer, [&](pid_t tid, uint64_t ticks, std::string_view name) {
+        _threadTicks[tid] = ticks;
+
+        const auto lastIt = _lastThreadTicks.find(tid);
+        const uint64_t lastTicks = lastIt == _lastThreadTicks.end() ? 0 : lastIt->second;
+        const double cpu = elapsed > 0.0
+                         ? (double)(ticks - lastTicks) / _ticksPerSecond / elapsed * 100.0
+                         : 0.0;
+
+        ControlCharactersEscaper::escape(name, escapedName, ControlCharactersEscaper::Mode::JSON);
+        fmt::format_to(std::back_inserter(_line), "{}{{\"tid\":{},\"name\":\"{}\",\"cpu\":{:.1f}}}",
+                       first ? "" : ",", tid, escapedName, cpu);
+        first = false;
+    });
+
+    if (!listed) {
+        _line.resize(begin);
+        return;
+    }
+
+    _line += ']';
+
+    // Only keep the threads still alive
+    _lastThreadTicks.swap(_threadTicks);
+}
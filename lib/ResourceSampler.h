@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <sys/types.h>
+
+#include "FlatHashMap.h"
+#include "TuringTime.h"
+
+// Background thread sampling the resources of the process at a fixed interval.
+// Each sample is written as one JSON object per line:
+// {"time":1.002,"rss_mb":120,"cpu":98.5,"fds":12,"rchar":...,"wchar":...,
+//  "read_bytes":...,"write_bytes":...,"threads":[{"tid":1,"name":"main","cpu":97.0}]}
+// cpu is in percent of one core over the last interval.
+// Only supported on Linux, start returns false elsewhere.
+class ResourceSampler {
+public:
+    using Path = std::filesystem::path;
+
+    ResourceSampler(const Path& outFile, std::chrono::milliseconds interval);
+    ~ResourceSampler();
+
+    ResourceSampler(const ResourceSampler&) = delete;
+    ResourceSampler(ResourceSampler&&) = delete;
+    ResourceSampler& operator=(const ResourceSampler&) = delete;
+    ResourceSampler& operator=(ResourceSampler&&) = delete;
+
+    bool start();
+    void stop();
+
+private:
+    const Path _outFile;
+    const std::chrono::milliseconds _interval;
+    std::ofstream _outStream;
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _stopCond;
+    bool _stopRequested {false};
+
+    int _statmFd {-1};
+    int _statFd {-1};
+    int _ioFd {-1};
+    size_t _pageSize {0};
+    double _ticksPerSecond {0.0};
+
+    TimePoint _startTime;
+    TimePoint _lastTime;
+    uint64_t _lastProcessTicks {0};
+    FlatHashMap<pid_t, uint64_t> _lastThreadTicks;
+    FlatHashMap<pid_t, uint64_t> _threadTicks;
+    std::string _buffer;
+    std::string _line;
+
+    void run();
+    void sample();
+    void appendThreads(double elapsed);
+    void closeFiles();
+};
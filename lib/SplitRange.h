@@ -0,0 +1,238 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <iterator>
+#include <string_view>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Set of characters searched 16 bytes at a time with SSE2 comparisons.
+// Single characters are searched with memchr, and sets of more than
+// MAX_SIMD_CHARS characters with a lookup table.
+class CharSet {
+public:
+    static constexpr size_t MAX_SIMD_CHARS = 8;
+
+    CharSet() = default;
+
+    explicit CharSet(std::string_view chars) {
+        for (const char c : chars) {
+            add(c);
+        }
+    }
+
+    void add(char c) {
+        if (_table[(uint8_t)c]) {
+            return;
+        }
+
+        _table[(uint8_t)c] = true;
+        if (_count < MAX_SIMD_CHARS) {
+            _chars[_count] = c;
+#ifdef __SSE2__
+            _vectors[_count] = _mm_set1_epi8(c);
+#endif
+        }
+        _count++;
+    }
+
+    bool contains(char c) const { return _table[(uint8_t)c]; }
+
+    // Position of the first character of the set in [pos, size), or size
+    size_t find(const char* data, size_t pos, size_t size) const {
+        if (_count == 1) {
+            const void* found = memchr(data + pos, _chars[0], size - pos);
+            return found ? static_cast<const char*>(found) - data : size;
+        }
+
+#ifdef __SSE2__
+        if (_count <= MAX_SIMD_CHARS) {
+            [[likely]]
+            while (pos + 16 <= size) {
+                const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+                __m128i match = _mm_setzero_si128();
+                for (size_t i = 0; i < _count; i++) {
+                    match = _mm_or_si128(match, _mm_cmpeq_epi8(block, _vectors[i]));
+                }
+
+                const uint32_t mask = _mm_movemask_epi8(match);
+                if (mask) {
+                    return pos + __builtin_ctz(mask);
+                }
+
+                pos += 16;
+            }
+        }
+#endif
+
+        while (pos < size && !_table[(uint8_t)data[pos]]) {
+            pos++;
+        }
+
+        return pos;
+    }
+
+private:
+    bool _table[256] {};
+    char _chars[MAX_SIMD_CHARS] {};
+#ifdef __SSE2__
+    __m128i _vectors[MAX_SIMD_CHARS] {};
+#endif
+    size_t _count {0};
+};
+
+// Lazy range over the fields of a string separated by any character of a
+// delimiter set. The fields are views on the string, nothing is allocated.
+//
+// An empty string has no field, and a trailing delimiter ends with an empty
+// field: "a,,b," gives "a", "", "b", "". skipEmpty drops the empty fields.
+//
+// With a quote character, a field starting with it extends to the closing
+// quote, delimiters included, and is returned without the quotes. Doubled
+// quotes inside are an escaped quote and are left as is. A quoted field that
+// is not followed by a delimiter or the end is returned raw, up to the next
+// delimiter, as is an unterminated one up to the end.
+struct SplitOptions {
+    bool skipEmpty {false};
+    char quote {'\0'};
+};
+
+class SplitRange {
+public:
+    using Options = SplitOptions;
+
+    class Iterator {
+    public:
+        using value_type = std::string_view;
+        using reference = const std::string_view&;
+        using pointer = const std::string_view*;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        Iterator() = default;
+
+        reference operator*() const { return _field; }
+        pointer operator->() const { return &_field; }
+
+        Iterator& operator++() {
+            next();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator temp = *this;
+            next();
+            return temp;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return _done == other._done && (_done || _field.data() == other._field.data());
+        }
+
+    private:
+        friend SplitRange;
+
+        static constexpr size_t NPOS = std::string_view::npos;
+
+        const SplitRange* _range {nullptr};
+        std::string_view _field;
+        size_t _next {NPOS};
+        bool _done {true};
+
+        explicit Iterator(const SplitRange* range)
+            : _range(range),
+            _next(range->_str.empty() ? NPOS : 0),
+            _done(false)
+        {
+            next();
+        }
+
+        void next() {
+            const std::string_view str = _range->_str;
+
+            for (;;) {
+                if (_next == NPOS) {
+                    _done = true;
+                    _field = {};
+                    return;
+                }
+
+                const size_t start = _next;
+                size_t end = 0;
+
+                if (_range->_quote && start < str.size() && str[start] == _range->_quote) {
+                    end = parseQuoted(start);
+                } else {
+                    end = _range->_delimiters.find(str.data(), start, str.size());
+                    _field = str.substr(start, end - start);
+                }
+
+                _next = end < str.size() ? end + 1 : NPOS;
+
+                if (!_field.empty() || !_range->_skipEmpty) {
+                    return;
+                }
+            }
+        }
+
+        // Sets the field starting with a quote at start, returns the
+        // position of the delimiter that ends it
+        size_t parseQuoted(size_t start) {
+            const std::string_view str = _range->_str;
+            const char quote = _range->_quote;
+
+            size_t pos = start + 1;
+            for (;;) {
+                const void* found = memchr(str.data() + pos, quote, str.size() - pos);
+                if (!found) {
+                    _field = str.substr(start);
+                    return str.size();
+                }
+
+                pos = static_cast<const char*>(found) - str.data();
+                if (pos + 1 < str.size() && str[pos + 1] == quote) {
+                    pos += 2;
+                    continue;
+                }
+
+                break;
+            }
+
+            const size_t close = pos;
+            if (close + 1 == str.size() || _range->_delimiters.contains(str[close + 1])) {
+                _field = str.substr(start + 1, close - start - 1);
+                return close + 1;
+            }
+
+            const size_t end = _range->_delimiters.find(str.data(), close + 1, str.size());
+            _field = str.substr(start, end - start);
+            return end;
+        }
+    };
+
+    using iterator = Iterator;
+    using const_iterator = Iterator;
+
+    SplitRange() = default;
+
+    SplitRange(std::string_view str, std::string_view delimiters, Options options = {})
+        : _str(str),
+        _delimiters(delimiters),
+        _skipEmpty(options.skipEmpty),
+        _quote(options.quote)
+    {}
+
+    Iterator begin() const { return Iterator(this); }
+    Iterator end() const { return Iterator(); }
+
+private:
+    std::string_view _str;
+    CharSet _delimiters;
+    bool _skipEmpty {false};
+    char _quote {'\0'};
+};
@@ -1,17 +1,372 @@
 #pragma once
 
-#include <sstream>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <bit>
+#include <charconv>
+#include <concepts>
+#include <limits>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "BasicResult.h"
+
+// Conversions of decimal strings to integers and floating point numbers,
+// based on std::from_chars: no locale, no allocation, no exception.
+// The whole string must be a number, an optional '+' sign is accepted.
+
+struct NumberParseError {
+    enum class Reason : uint8_t {
+        Empty,
+        InvalidCharacter,
+        TrailingCharacters,
+        OutOfRange,
+    };
+
+    Reason reason {Reason::Empty};
+
+    // Offset of the first character that could not be parsed
+    size_t position {0};
+
+    static const char* getReasonName(Reason reason) {
+        switch (reason) {
+            case Reason::Empty: return "empty";
+            case Reason::InvalidCharacter: return "invalid character";
+            case Reason::TrailingCharacters: return "trailing characters";
+            case Reason::OutOfRange: return "out of range";
+        }
+        return "unknown";
+    }
+};
 
 template <typename NumberType>
+concept ParsableNumber = std::is_arithmetic_v<NumberType> && !std::same_as<NumberType, bool>;
+
+template <ParsableNumber NumberType>
+BasicResult<NumberType, NumberParseError> StringToNumber(std::string_view str) {
+    using Reason = NumberParseError::Reason;
+
+    if (str.empty()) {
+        return BadResult<NumberParseError>(NumberParseError {Reason::Empty, 0});
+    }
+
+    const char* begin = str.data();
+    const char* end = begin + str.size();
+
+    // from_chars only accepts the minus sign
+    if (*begin == '+') {
+        begin++;
+        if (begin == end) {
+            return BadResult<NumberParseError>(NumberParseError {Reason::Empty, 1});
+        }
+
+        if (*begin == '-') {
+            return BadResult<NumberParseError>(NumberParseError {Reason::InvalidCharacter, 1});
+        }
+    }
+
+    NumberType value {};
+    std::from_chars_result res;
+    if constexpr (std::is_floating_point_v<NumberType>) {
+        res = std::from_chars(begin, end, value, std::chars_format::general);
+    } else {
+        res = std::from_chars(begin, end, value, 10);
+    }
+
+    if (res.ec == std::errc::invalid_argument) {
+        return BadResult<NumberParseError>(NumberParseError {Reason::InvalidCharacter, (size_t)(begin - str.data())});
+    }
+
+    if (res.ec == std::errc::result_out_of_range) {
+        return BadResult<NumberParseError>(NumberParseError {Reason::OutOfRange, (size_t)(begin - str.data())});
+    }
+
+    if (res.ptr != end) {
+        return BadResult<NumberParseError>(NumberParseError {Reason::TrailingCharacters, (size_t)(res.ptr - str.data())});
+    }
+
+    return value;
+}
+
+template <ParsableNumber NumberType>
 NumberType StringToNumber(std::string_view str, bool& error) {
-    try {
-        NumberType res {0};
-        std::istringstream iss;
-        iss >> res;
-        error = false;
-        return res;
-    } catch (const std::exception& e) {
-        error = true;
-        return 0;
+    const auto res = StringToNumber<NumberType>(str);
+    error = !res.has_value();
+    return res.has_value() ? res.value() : 0;
+}
+
+namespace string_to_number_detail {
+
+// SWAR parsing of 8 digits loaded in a little-endian 64-bit word,
+// see D. Lemire, "Quickly parsing eight digits"
+inline bool isEightDigits(uint64_t chunk) {
+    return ((chunk & 0xF0F0F0F0F0F0F0F0ull)
+          | (((chunk + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4))
+        == 0x3333333333333333ull;
+}
+
+inline uint64_t parseEightDigits(uint64_t chunk) {
+    chunk = (chunk & 0x0F0F0F0F0F0F0F0Full) * 2561 >> 8;
+    chunk = (chunk & 0x00FF00FF00FF00FFull) * 6553601 >> 16;
+    return (chunk & 0x0000FFFF0000FFFFull) * 42949672960001ull >> 32;
+}
+
+// Parses 1 to 16 digits, returns false if a character is not a digit
+inline bool parseDigits(const char* data, size_t len, uint64_t& value) {
+    char digits[16];
+    memset(digits, '0', sizeof(digits));
+    memcpy(digits + sizeof(digits) - len, data, len);
+
+    uint64_t hi = 0;
+    uint64_t lo = 0;
+    memcpy(&hi, digits, 8);
+    memcpy(&lo, digits + 8, 8);
+
+    if (!isEightDigits(hi) || !isEightDigits(lo)) {
+        return false;
     }
+
+    value = parseEightDigits(hi) * 100000000ull + parseEightDigits(lo);
+    return true;
+}
+
+template <typename NumberType>
+concept ShortInteger = std::integral<NumberType>
+                    && sizeof(NumberType) <= sizeof(uint64_t)
+                    && std::endian::native == std::endian::little;
+
+// Converts the parsed digits to NumberType, returns false if out of range
+template <ShortInteger NumberType>
+inline bool applySign(uint64_t digits, bool negative, NumberType& value) {
+    if (negative) {
+        if constexpr (std::is_unsigned_v<NumberType>) {
+            return false;
+        } else {
+            const uint64_t limit = (uint64_t)std::numeric_limits<NumberType>::max() + 1;
+            if (digits > limit) {
+                return false;
+            }
+            value = (NumberType)(0 - digits);
+            return true;
+        }
+    }
+
+    if (digits > (uint64_t)std::numeric_limits<NumberType>::max()) {
+        return false;
+    }
+
+    value = (NumberType)digits;
+    return true;
+}
+
+// Fast path for integer fields of at most 16 digits with an optional sign.
+// Returns false for anything else, which is left to StringToNumber
+template <std::integral NumberType>
+inline bool parseShortInteger(std::string_view str, NumberType& value) {
+    if constexpr (!ShortInteger<NumberType>) {
+        return false;
+    } else {
+        const char* data = str.data();
+        size_t len = str.size();
+
+        bool negative = false;
+        if (len > 0 && (*data == '-' || *data == '+')) {
+            negative = *data == '-';
+            data++;
+            len--;
+        }
+
+        if (len == 0 || len > 16) {
+            return false;
+        }
+
+        uint64_t digits = 0;
+        if (!parseDigits(data, len, digits)) {
+            return false;
+        }
+
+        return applySign(digits, negative, value);
+    }
+}
+
+// Parses the field [pos, end) of column into value, or sets error with
+// its position in column
+template <ParsableNumber NumberType>
+inline bool parseField(std::string_view column, size_t pos, size_t end,
+                       NumberType& value, NumberParseError& error) {
+    const std::string_view field(column.data() + pos, end - pos);
+
+    if constexpr (std::is_integral_v<NumberType>) {
+        if (parseShortInteger(field, value)) {
+            return true;
+        }
+    }
+
+    const auto res = StringToNumber<NumberType>(field);
+    if (!res.has_value()) {
+        error = res.error();
+        error.position += pos;
+        return false;
+    }
+
+    value = res.value();
+    return true;
+}
+
+#if defined(__x86_64__)
+
+// Shuffle masks right-aligning len bytes in a 16-byte register, the mask
+// for len starts at SHUFFLE_WINDOW + len. Leading bytes are zeroed
+alignas(32) inline constexpr uint8_t SHUFFLE_WINDOW[32] = {
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+};
+
+// Parses the 1 to 16 digits at data, 16 bytes must be readable there.
+// The digits are right-aligned with pshufb, then combined by pairs with
+// pmaddubsw, by 4 with pmaddwd, and by 8 with a second pmaddwd after
+// packing to 16 bits, which all fit in SSSE3
+[[gnu::target("ssse3")]]
+inline bool parseDigitsSSSE3(const char* data, size_t len, uint64_t& value) {
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    const __m128i digits = _mm_sub_epi8(chunk, _mm_set1_epi8('0'));
+
+    // Bytes other than '0' to '9' wrap around to values above 9
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i valid = _mm_cmpeq_epi8(_mm_max_epu8(digits, nine), nine);
+    const uint32_t lenMask = (1u << len) - 1;
+    if (((uint32_t)_mm_movemask_epi8(valid) & lenMask) != lenMask) {
+        return false;
+    }
+
+    const __m128i shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i*>(SHUFFLE_WINDOW + len));
+    const __m128i aligned = _mm_shuffle_epi8(digits, shuffle);
+
+    const __m128i pairs = _mm_maddubs_epi16(aligned, _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1,
+                                                                   10, 1, 10, 1, 10, 1, 10, 1));
+    const __m128i quads = _mm_madd_epi16(pairs, _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1));
+    const __m128i packed = _mm_packs_epi32(quads, quads);
+    const __m128i octets = _mm_madd_epi16(packed, _mm_setr_epi16(10000, 1, 10000, 1,
+                                                                 10000, 1, 10000, 1));
+
+    const uint64_t hi = (uint32_t)_mm_cvtsi128_si32(octets);
+    const uint64_t lo = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(octets, 4));
+    value = hi * 100000000ull + lo;
+    return true;
+}
+
+// StringToNumberColumn for integers. A field whose delimiter is in the
+// next 16 bytes is found with one comparison instead of memchr and parsed
+// with parseDigitsSSSE3. Fields near the end of column, longer ones and
+// anything the kernel rejects go through parseField
+template <ShortInteger NumberType>
+[[gnu::target("ssse3")]]
+BasicResult<size_t, NumberParseError> parseIntegerColumnSSSE3(std::string_view column,
+                                                              char delimiter,
+                                                              std::vector<NumberType>& values) {
+    const size_t initialSize = values.size();
+    const char* data = column.data();
+    const size_t size = column.size();
+    const __m128i delimiters = _mm_set1_epi8(delimiter);
+    size_t pos = 0;
+
+    while (pos < size) {
+        // 16 bytes readable past a sign
+        if (pos + 17 <= size) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+            const uint32_t found = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, delimiters));
+            if (found) {
+                const size_t len = std::countr_zero(found);
+                const bool hasSign = data[pos] == '-' || data[pos] == '+';
+                const size_t start = pos + hasSign;
+
+                uint64_t digits = 0;
+                NumberType value {};
+                if (len > hasSign
+                    && parseDigitsSSSE3(data + start, len - hasSign, digits)
+                    && applySign(digits, data[pos] == '-', value)) {
+                    values.push_back(value);
+                    pos += len + 1;
+                    continue;
+                }
+            }
+        }
+
+        const void* found = memchr(data + pos, delimiter, size - pos);
+        const size_t end = found ? static_cast<const char*>(found) - data : size;
+
+        NumberType value {};
+        NumberParseError error;
+        if (!parseField(column, pos, end, value, error)) {
+            return BadResult<NumberParseError>(error);
+        }
+
+        values.push_back(value);
+        pos = end + 1;
+    }
+
+    return values.size() - initialSize;
+}
+
+// SSSE3 kernels unless TURING_STRING_TO_NUMBER_ISA=scalar
+inline bool useSSSE3() {
+    static const bool enabled = [] {
+        const char* requested = getenv("TURING_STRING_TO_NUMBER_ISA");
+        return __builtin_cpu_supports("ssse3")
+            && !(requested && std::string_view(requested) == "scalar");
+    }();
+    return enabled;
+}
+
+#endif
+
+}
+
+// Parses a column of numbers separated by delimiter, e.g. one per line,
+// and appends them to values. A trailing delimiter is accepted.
+// Integers of up to 16 digits go through a fast path: an SSSE3 kernel on
+// x86-64 CPUs that have it, a SWAR one otherwise.
+// Returns the number of values parsed, or the first error with its
+// position in column. values then holds the numbers parsed before it.
+template <ParsableNumber NumberType>
+BasicResult<size_t, NumberParseError> StringToNumberColumn(std::string_view column,
+                                                           char delimiter,
+                                                           std::vector<NumberType>& values) {
+#if defined(__x86_64__)
+    if constexpr (string_to_number_detail::ShortInteger<NumberType>) {
+        if (string_to_number_detail::useSSSE3()) {
+            return string_to_number_detail::parseIntegerColumnSSSE3(column, delimiter, values);
+        }
+    }
+#endif
+
+    const size_t initialSize = values.size();
+    const char* data = column.data();
+    const size_t size = column.size();
+    size_t pos = 0;
+
+    while (pos < size) {
+        const void* found = memchr(data + pos, delimiter, size - pos);
+        const size_t end = found ? static_cast<const char*>(found) - data : size;
+
+        NumberType value {};
+        NumberParseError error;
+        if (!string_to_number_detail::parseField(column, pos, end, value, error)) {
+            return BadResult<NumberParseError>(error);
+        }
+
+        values.push_back(value);
+        pos = end + 1;
+    }
+
+    return values.size() - initialSize;
 }
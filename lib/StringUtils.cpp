@@ -3,17 +3,11 @@
 void StringUtils::splitString(std::string_view str,
                               char sep,
                               std::vector<std::string_view>& res) {
-    size_t pos = 0;
-
-    while (pos < str.size()) {
-        const size_t delimiterPos = str.find(sep, pos);
+    for (const std::string_view field : split(str, std::string_view(&sep, 1))) {
+        res.push_back(field);
+    }
 
-        if (delimiterPos == std::string_view::npos) {
-            res.push_back(str.substr(pos));
-            pos = str.size();
-        } else {
-            res.push_back(str.substr(pos, delimiterPos-pos));
-            pos = delimiterPos+1;
-        }
+    if (str.ends_with(sep)) {
+        res.pop_back();
     }
 }
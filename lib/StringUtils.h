@@ -3,11 +3,23 @@
 #include <string_view>
 #include <vector>
 
+#include "SplitRange.h"
+
 class StringUtils {
 public:
     StringUtils() = delete;
 
+    // Appends the fields of str to res. A trailing separator does not
+    // add an empty field, unlike split
     static void splitString(std::string_view str,
                             char sep,
                             std::vector<std::string_view>& res);
+
+    // Lazy range over the fields of str separated by any of the delimiters,
+    // see SplitRange
+    static SplitRange split(std::string_view str,
+                            std::string_view delimiters,
+                            SplitOptions options = {}) {
+        return SplitRange(str, delimiters, options);
+    }
 };
@@ -1,35 +1,127 @@
 #include "TimerStat.h"
 
+#include <string.h>
+#include <algorithm>
+
 #include "PerfStat.h"
 
-using namespace std::literals;
-using FloatDuration = std::chrono::duration<float>;
+namespace {
+
+// Innermost running phase of the thread, in the PerfStat instance of
+// the generation
+struct CurrentPhase {
+    uint64_t generation {0};
+    size_t phase {0};
+};
+
+thread_local CurrentPhase currentPhase;
+
+}
 
 TimerStat::TimerStat()
-    : _start(Clock::now())
+    : TimerStat("PerfStat")
 {
 }
 
-TimerStat::TimerStat(const std::string& msg)
-    : _start(Clock::now()),
-      _msg(msg)
+TimerStat::TimerStat(std::string_view msg)
+    : _start(Clock::now())
 {
+    _msgSize = std::min(msg.size(), MSG_CAPACITY);
+    memcpy(_msg, msg.data(), _msgSize);
+
+    start();
+}
+
+void TimerStat::start() {
+    PerfStat* perfStatInst = PerfStat::getInstance();
+    if (!perfStatInst) {
+        return;
+    }
+
+    _startUsage = PerfStat::getThreadResourceUsage();
+    perfStatInst->getIoUsage(_startIo);
+    _generation = perfStatInst->_generation;
+
+    // A phase left by a previous instance is not a parent
+    _parentPhase = currentPhase.generation == _generation ? currentPhase.phase : 0;
+    _phase = perfStatInst->enterPhase(_parentPhase, getMsg());
+    currentPhase = {_generation, _phase};
+
+    if constexpr (AllocTracker::enabled) {
+        AllocTracker::beginScope(_allocScope);
+    }
+
+    // Do not account for the bookkeeping
+    _start = Clock::now();
 }
 
 TimerStat::~TimerStat() {
-    if (!PerfStat::getInstance()) {
+    if (_phase == 0) {
         return;
     }
 
+    const float seconds = duration<Seconds>(_start, Clock::now());
+    currentPhase = {_generation, _parentPhase};
+
+    AllocTracker::Delta allocs;
+    if constexpr (AllocTracker::enabled) {
+        allocs = AllocTracker::endScope(_allocScope);
+    }
+
     PerfStat* perfStatInst = PerfStat::getInstance();
-    std::ofstream& file = perfStatInst->_outStream;
-    if (file.is_open()) {
-        const float seconds = duration<Seconds>(_start, Clock::now());
+    if (!perfStatInst || perfStatInst->_generation != _generation) {
+        // Started with a destroyed instance, its phase index is meaningless
+        return;
+    }
 
+    const PerfStat::ResourceUsage usage = PerfStat::getThreadResourceUsage();
+    const size_t peakRss = PerfStat::getResourceUsage().peakRss;
+
+    PerfStat::IoUsage io;
+    const bool hasIo = perfStatInst->getIoUsage(io);
+    if (hasIo) {
+        io = PerfStat::diffIoUsage(io, _startIo);
+    }
+
+    perfStatInst->leavePhase(_phase, {
+        .seconds = seconds,
+        .userTime = usage.userTime - _startUsage.userTime,
+        .sysTime = usage.sysTime - _startUsage.sysTime,
+        .minorFaults = usage.minorFaults - _startUsage.minorFaults,
+        .majorFaults = usage.majorFaults - _startUsage.majorFaults,
+        .voluntarySwitches = usage.voluntarySwitches - _startUsage.voluntarySwitches,
+        .involuntarySwitches = usage.involuntarySwitches - _startUsage.involuntarySwitches,
+        .peakRss = peakRss,
+        .allocs = allocs,
+        .io = io,
+    });
+
+    std::scoped_lock guard(perfStatInst->_mutex);
+    std::ofstream& file = perfStatInst->_outStream;
+    if (perfStatInst->_eventLines && file.is_open()) {
         const auto [reserved, physical] = perfStatInst->getMemInMegabytes();
 
-        file << '[' << _msg << "] "
-             << "[vmem=" << reserved << "MB, vrss=" << physical << "MB] "
-             << std::to_string(seconds) << " s\n";
+        file << '[' << getMsg() << "] "
+             << "[vmem=" << reserved << "MB, vrss=" << physical << "MB"
+             << ", peak=" << peakRss << "MB] "
+             << "[user=" << usage.userTime - _startUsage.userTime << "s"
+             << ", sys=" << usage.sysTime - _startUsage.sysTime << "s"
+             << ", minflt=" << usage.minorFaults - _startUsage.minorFaults
+             << ", majflt=" << usage.majorFaults - _startUsage.majorFaults
+             << ", vcsw=" << usage.voluntarySwitches - _startUsage.voluntarySwitches
+             << ", ivcsw=" << usage.involuntarySwitches - _startUsage.involuntarySwitches << "] ";
+
+        if constexpr (AllocTracker::enabled) {
+            file << "[allocs=" << allocs.allocCount
+                 << ", allocated=" << allocs.allocBytes << "B"
+                 << ", freed=" << allocs.freedBytes << "B"
+                 << ", peak=" << allocs.peakBytes << "B] ";
+        }
+
+        if (hasIo) {
+            file << PerfStat::formatIoUsage(io, seconds) << ' ';
+        }
+
+        file << std::to_string(seconds) << " s\n";
     }
 }
@@ -1,21 +1,40 @@
 #pragma once
 
-#include <string>
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
 
+#include "PerfStat.h"
 #include "TuringTime.h"
 
+// Times a phase of the program and reports it to PerfStat.
+// TimerStat scopes nest per thread and are aggregated by PerfStat.
+// The message is copied in place (truncated to MSG_CAPACITY)
+// so that constructing a TimerStat does not allocate.
 class TimerStat {
 public:
+    static constexpr size_t MSG_CAPACITY = 128;
+
     TimerStat(const TimerStat& other) = delete;
     TimerStat(TimerStat&& other) = delete;
     TimerStat& operator=(const TimerStat& other) = delete;
     TimerStat& operator=(TimerStat&& other) = delete;
 
     TimerStat();
-    TimerStat(const std::string& msg);
+    TimerStat(std::string_view msg);
     ~TimerStat();
 
 private:
     TimePoint _start;
-    std::string _msg = "PerfStat";
+    PerfStat::ResourceUsage _startUsage;
+    AllocTracker::Scope _allocScope;
+    PerfStat::IoUsage _startIo;
+    uint64_t _generation {0};
+    size_t _phase {0};
+    size_t _parentPhase {0};
+    uint32_t _msgSize {0};
+    char _msg[MSG_CAPACITY];
+
+    void start();
+    std::string_view getMsg() const { return std::string_view(_msg, _msgSize); }
 };
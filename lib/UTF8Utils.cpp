@@ -0,0 +1,757 @@
+#include "UTF8Utils.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <array>
+#include <iterator>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Kernels run over the whole input, the transcoders use them to validate
+// before decoding without checks
+using ValidateKernel = bool (*)(const char* data, size_t len);
+using CountKernel = size_t (*)(const char* data, size_t len);
+using OffsetKernel = size_t (*)(const char* data, size_t len, size_t index);
+
+struct Kernels {
+    const char* name {nullptr};
+    ValidateKernel validate {nullptr};
+    CountKernel count {nullptr};
+    OffsetKernel offset {nullptr};
+};
+
+bool isContinuation(uint8_t c) {
+    return (c & 0xC0) == 0x80;
+}
+
+// Decodes the character at s, returns its length or 0 if it is malformed
+size_t decodeChecked(const uint8_t* s, size_t len, uint32_t& codePoint) {
+    static constexpr uint32_t MIN_CODE_POINT[] = {0, 0, 0x80, 0x800, 0x10000};
+
+    const uint8_t c = s[0];
+    size_t size = 0;
+    if (c < 0x80) {
+        codePoint = c;
+        return 1;
+    } else if ((c & 0xE0) == 0xC0) {
+        size = 2;
+        codePoint = c & 0x1F;
+    } else if ((c & 0xF0) == 0xE0) {
+        size = 3;
+        codePoint = c & 0x0F;
+    } else if ((c & 0xF8) == 0xF0) {
+        size = 4;
+        codePoint = c & 0x07;
+    } else {
+        return 0;
+    }
+
+    if (size > len) {
+        return 0;
+    }
+
+    for (size_t i = 1; i < size; i++) {
+        if (!isContinuation(s[i])) {
+            return 0;
+        }
+        codePoint = (codePoint << 6) | (s[i] & 0x3F);
+    }
+
+    if (codePoint < MIN_CODE_POINT[size]
+        || codePoint > 0x10FFFF
+        || (codePoint >= 0xD800 && codePoint <= 0xDFFF)) {
+        return 0;
+    }
+
+    return size;
+}
+
+// Decodes the character at s of a validated string, returns its length
+size_t decodeValid(const uint8_t* s, uint32_t& codePoint) {
+    const uint8_t c = s[0];
+    if (c < 0xE0) {
+        codePoint = ((c & 0x1F) << 6) | (s[1] & 0x3F);
+        return 2;
+    } else if (c < 0xF0) {
+        codePoint = ((c & 0x0F) << 12) | ((s[1] & 0x3F) << 6) | (s[2] & 0x3F);
+        return 3;
+    } else {
+        codePoint = ((c & 0x07) << 18) | ((s[1] & 0x3F) << 12)
+                  | ((s[2] & 0x3F) << 6) | (s[3] & 0x3F);
+        return 4;
+    }
+}
+
+size_t encodeUTF8(uint32_t codePoint, char* out) {
+    if (codePoint < 0x80) {
+        out[0] = codePoint;
+        return 1;
+    } else if (codePoint < 0x800) {
+        out[0] = 0xC0 | (codePoint >> 6);
+        out[1] = 0x80 | (codePoint & 0x3F);
+        return 2;
+    } else if (codePoint < 0x10000) {
+        out[0] = 0xE0 | (codePoint >> 12);
+        out[1] = 0x80 | ((codePoint >> 6) & 0x3F);
+        out[2] = 0x80 | (codePoint & 0x3F);
+        return 3;
+    } else {
+        out[0] = 0xF0 | (codePoint >> 18);
+        out[1] = 0x80 | ((codePoint >> 12) & 0x3F);
+        out[2] = 0x80 | ((codePoint >> 6) & 0x3F);
+        out[3] = 0x80 | (codePoint & 0x3F);
+        return 4;
+    }
+}
+
+bool validateScalar(const char* data, size_t len) {
+    const uint8_t* s = reinterpret_cast<const uint8_t*>(data);
+    size_t pos = 0;
+
+    while (pos < len) {
+        if (pos + 8 <= len) {
+            uint64_t word = 0;
+            memcpy(&word, s + pos, 8);
+            if ((word & 0x8080808080808080ull) == 0) {
+                pos += 8;
+                continue;
+            }
+        }
+
+        uint32_t codePoint = 0;
+        const size_t size = decodeChecked(s + pos, len - pos, codePoint);
+        if (size == 0) {
+            return false;
+        }
+        pos += size;
+    }
+
+    return true;
+}
+
+size_t countScalar(const char* data, size_t len) {
+    size_t count = 0;
+    for (size_t i = 0; i < len; i++) {
+        count += !isContinuation(data[i]);
+    }
+    return count;
+}
+
+size_t offsetScalar(const char* data, size_t len, size_t index) {
+    for (size_t pos = 0; pos < len; pos++) {
+        if (!isContinuation(data[pos])) {
+            if (index == 0) {
+                return pos;
+            }
+            index--;
+        }
+    }
+
+    return len;
+}
+
+#if defined(__x86_64__)
+
+// Error bits of the lookup tables, set when the two bytes of a pair match
+// the pattern of the error
+constexpr uint8_t TOO_SHORT = 1 << 0;      // 11______ 0_______ or 11______ 11______
+constexpr uint8_t TOO_LONG = 1 << 1;       // 0_______ 10______
+constexpr uint8_t OVERLONG_3 = 1 << 2;     // 11100000 100_____
+constexpr uint8_t TOO_LARGE = 1 << 3;      // 11110100 1001____ and above
+constexpr uint8_t SURROGATE = 1 << 4;      // 11101101 101_____
+constexpr uint8_t OVERLONG_2 = 1 << 5;     // 1100000_ 10______
+constexpr uint8_t TOO_LARGE_1000 = 1 << 6; // 11110101 1000____ and above
+constexpr uint8_t OVERLONG_4 = 1 << 6;     // 11110000 1000____
+constexpr uint8_t TWO_CONTS = 1 << 7;      // 10______ 10______, valid in 3 and 4 byte characters
+constexpr uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+// Indexed by the high nibble of the first byte of a pair
+alignas(16) constexpr std::array<uint8_t, 16> BYTE_1_HIGH = {
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    TOO_SHORT | OVERLONG_2,
+    TOO_SHORT,
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+};
+
+// Indexed by the low nibble of the first byte of a pair
+alignas(16) constexpr std::array<uint8_t, 16> BYTE_1_LOW = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+};
+
+// Indexed by the high nibble of the second byte of a pair
+alignas(16) constexpr std::array<uint8_t, 16> BYTE_2_HIGH = {
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+};
+
+// A block is incomplete if one of its last 3 bytes starts a character
+// that does not fit in the block
+constexpr std::array<uint8_t, 32> makeIncompleteMax() {
+    std::array<uint8_t, 32> max {};
+    max.fill(0xFF);
+    max[29] = 0xF0 - 1;
+    max[30] = 0xE0 - 1;
+    max[31] = 0xC0 - 1;
+    return max;
+}
+
+alignas(32) constexpr std::array<uint8_t, 32> INCOMPLETE_MAX = makeIncompleteMax();
+
+struct State128 {
+    __m128i prevInput;
+    __m128i prevIncomplete;
+    __m128i error;
+};
+
+[[gnu::target("ssse3")]]
+inline void checkBlock128(__m128i input, State128& state) {
+    if (_mm_movemask_epi8(input) == 0) {
+        // ASCII: only the previous block can be wrong
+        state.error = _mm_or_si128(state.error, state.prevIncomplete);
+        state.prevIncomplete = _mm_setzero_si128();
+        state.prevInput = input;
+        return;
+    }
+
+    const __m128i lowNibble = _mm_set1_epi8(0x0F);
+    const __m128i prev1 = _mm_alignr_epi8(input, state.prevInput, 15);
+
+    const __m128i byte1High = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(BYTE_1_HIGH.data())),
+                                               _mm_and_si128(_mm_srli_epi16(prev1, 4), lowNibble));
+    const __m128i byte1Low = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(BYTE_1_LOW.data())),
+                                              _mm_and_si128(prev1, lowNibble));
+    const __m128i byte2High = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(BYTE_2_HIGH.data())),
+                                               _mm_and_si128(_mm_srli_epi16(input, 4), lowNibble));
+    const __m128i special = _mm_and_si128(_mm_and_si128(byte1High, byte1Low), byte2High);
+
+    // Bytes 2 and 3 positions after a 3 or 4 byte lead must be continuations,
+    // which cancels the TWO_CONTS bit of the special cases
+    const __m128i prev2 = _mm_alignr_epi8(input, state.prevInput, 14);
+    const __m128i prev3 = _mm_alignr_epi8(input, state.prevInput, 13);
+    const __m128i isThird = _mm_subs_epu8(prev2, _mm_set1_epi8(0xE0 - 0x80));
+    const __m128i isFourth = _mm_subs_epu8(prev3, _mm_set1_epi8(0xF0 - 0x80));
+    const __m128i mustBeCont = _mm_and_si128(_mm_or_si128(isThird, isFourth), _mm_set1_epi8(0x80));
+
+    state.error = _mm_or_si128(state.error, _mm_xor_si128(mustBeCont, special));
+    state.prevIncomplete = _mm_subs_epu8(input, _mm_load_si128(reinterpret_cast<const __m128i*>(INCOMPLETE_MAX.data() + 16)));
+    state.prevInput = input;
+}
+
+[[gnu::target("ssse3")]]
+bool validateSSSE3(const char* data, size_t len) {
+    State128 state {_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128()};
+
+    size_t pos = 0;
+    while (pos + 16 <= len) {
+        checkBlock128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos)), state);
+        pos += 16;
+    }
+
+    if (pos < len) {
+        // Padding the tail with ASCII makes a truncated character an error
+        alignas(16) char tail[16] {};
+        memcpy(tail, data + pos, len - pos);
+        checkBlock128(_mm_load_si128(reinterpret_cast<const __m128i*>(tail)), state);
+    }
+
+    const __m128i error = _mm_or_si128(state.error, state.prevIncomplete);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xFFFF;
+}
+
+// Characters are counted by their first byte, the bytes that are not
+// continuations, which are greater than -65 as signed bytes
+size_t countSSE2(const char* data, size_t len) {
+    const __m128i threshold = _mm_set1_epi8(-65);
+    size_t count = 0;
+    size_t pos = 0;
+
+    while (pos + 16 <= len) {
+        // Per byte counters, summed before they can overflow
+        __m128i counters = _mm_setzero_si128();
+        const size_t blocks = std::min<size_t>((len - pos) / 16, 255);
+        for (size_t i = 0; i < blocks; i++) {
+            const __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+            counters = _mm_sub_epi8(counters, _mm_cmpgt_epi8(input, threshold));
+            pos += 16;
+        }
+
+        const __m128i sums = _mm_sad_epu8(counters, _mm_setzero_si128());
+        count += _mm_cvtsi128_si64(sums) + _mm_extract_epi16(sums, 4);
+    }
+
+    return count + countScalar(data + pos, len - pos);
+}
+
+size_t offsetSSE2(const char* data, size_t len, size_t index) {
+    const __m128i threshold = _mm_set1_epi8(-65);
+    size_t pos = 0;
+
+    while (pos + 16 <= len) {
+        const __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        uint32_t starts = _mm_movemask_epi8(_mm_cmpgt_epi8(input, threshold));
+        const size_t count = __builtin_popcount(starts);
+
+        if (index < count) {
+            for (size_t i = 0; i < index; i++) {
+                starts &= starts - 1;
+            }
+            return pos + __builtin_ctz(starts);
+        }
+
+        index -= count;
+        pos += 16;
+    }
+
+    return pos + offsetScalar(data + pos, len - pos, index);
+}
+
+#define AVX2_TARGET gnu::target("avx2,bmi,bmi2,popcnt")
+
+struct State256 {
+    __m256i prevInput;
+    __m256i prevIncomplete;
+    __m256i error;
+};
+
+[[AVX2_TARGET]]
+inline __m256i loadTable256(const std::array<uint8_t, 16>& table) {
+    return _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(table.data())));
+}
+
+[[AVX2_TARGET]]
+inline void checkBlock256(__m256i input, State256& state) {
+    if (_mm256_movemask_epi8(input) == 0) {
+        state.error = _mm256_or_si256(state.error, state.prevIncomplete);
+        state.prevIncomplete = _mm256_setzero_si256();
+        state.prevInput = input;
+        return;
+    }
+
+    // The bytes preceding each byte of input, across the two 128-bit lanes
+    const __m256i shifted = _mm256_permute2x128_si256(state.prevInput, input, 0x21);
+    const __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+    const __m256i prev2 = _mm256_alignr_epi8(input, shifted, 14);
+    const __m256i prev3 = _mm256_alignr_epi8(input, shifted, 13);
+
+    const __m256i lowNibble = _mm256_set1_epi8(0x0F);
+    const __m256i byte1High = _mm256_shuffle_epi8(loadTable256(BYTE_1_HIGH),
+                                                  _mm256_and_si256(_mm256_srli_epi16(prev1, 4), lowNibble));
+    const __m256i byte1Low = _mm256_shuffle_epi8(loadTable256(BYTE_1_LOW),
+                                                 _mm256_and_si256(prev1, lowNibble));
+    const __m256i byte2High = _mm256_shuffle_epi8(loadTable256(BYTE_2_HIGH),
+                                                  _mm256_and_si256(_mm256_srli_epi16(input, 4), lowNibble));
+    const __m256i special = _mm256_and_si256(_mm256_and_si256(byte1High, byte1Low), byte2High);
+
+    const __m256i isThird = _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xE0 - 0x80));
+    const __m256i isFourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xF0 - 0x80));
+    const __m256i mustBeCont = _mm256_and_si256(_mm256_or_si256(isThird, isFourth), _mm256_set1_epi8(0x80));
+
+    state.error = _mm256_or_si256(state.error, _mm256_xor_si256(mustBeCont, special));
+    state.prevIncomplete = _mm256_subs_epu8(input, _mm256_load_si256(reinterpret_cast<const __m256i*>(INCOMPLETE_MAX.data())));
+    state.prevInput = input;
+}
+
+[[AVX2_TARGET]]
+bool validateAVX2(const char* data, size_t len) {
+    State256 state {_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256()};
+
+    size_t pos = 0;
+    while (pos + 32 <= len) {
+        checkBlock256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos)), state);
+        pos += 32;
+    }
+
+    if (pos < len) {
+        alignas(32) char tail[32] {};
+        memcpy(tail, data + pos, len - pos);
+        checkBlock256(_mm256_load_si256(reinterpret_cast<const __m256i*>(tail)), state);
+    }
+
+    const __m256i error = _mm256_or_si256(state.error, state.prevIncomplete);
+    return _mm256_testz_si256(error, error);
+}
+
+[[AVX2_TARGET]]
+size_t countAVX2(const char* data, size_t len) {
+    const __m256i threshold = _mm256_set1_epi8(-65);
+    size_t count = 0;
+    size_t pos = 0;
+
+    while (pos + 32 <= len) {
+        __m256i counters = _mm256_setzero_si256();
+        const size_t blocks = std::min<size_t>((len - pos) / 32, 255);
+        for (size_t i = 0; i < blocks; i++) {
+            const __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+            counters = _mm256_sub_epi8(counters, _mm256_cmpgt_epi8(input, threshold));
+            pos += 32;
+        }
+
+        const __m256i sums = _mm256_sad_epu8(counters, _mm256_setzero_si256());
+        count += _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1)
+               + _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3);
+    }
+
+    return count + countScalar(data + pos, len - pos);
+}
+
+[[AVX2_TARGET]]
+size_t offsetAVX2(const char* data, size_t len, size_t index) {
+    const __m256i threshold = _mm256_set1_epi8(-65);
+    size_t pos = 0;
+
+    while (pos + 32 <= len) {
+        const __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        const uint32_t starts = _mm256_movemask_epi8(_mm256_cmpgt_epi8(input, threshold));
+        const size_t count = _mm_popcnt_u32(starts);
+
+        if (index < count) {
+            // Position of the index-th set bit
+            return pos + _tzcnt_u32(_pdep_u32(1u << index, starts));
+        }
+
+        index -= count;
+        pos += 32;
+    }
+
+    return pos + offsetScalar(data + pos, len - pos, index);
+}
+
+#undef AVX2_TARGET
+
+// Leading ASCII characters widened or narrowed 16 at a time, the functions
+// return the number of characters converted
+size_t widenASCII(const char* src, size_t len, char16_t* dst) {
+    size_t pos = 0;
+    while (pos + 16 <= len) {
+        const __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos));
+        if (_mm_movemask_epi8(input)) {
+            break;
+        }
+
+        const __m128i zero = _mm_setzero_si128();
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos), _mm_unpacklo_epi8(input, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos + 8), _mm_unpackhi_epi8(input, zero));
+        pos += 16;
+    }
+
+    return pos;
+}
+
+size_t widenASCII(const char* src, size_t len, char32_t* dst) {
+    size_t pos = 0;
+    while (pos + 16 <= len) {
+        const __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos));
+        if (_mm_movemask_epi8(input)) {
+            break;
+        }
+
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i lo = _mm_unpacklo_epi8(input, zero);
+        const __m128i hi = _mm_unpackhi_epi8(input, zero);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos), _mm_unpacklo_epi16(lo, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos + 4), _mm_unpackhi_epi16(lo, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos + 8), _mm_unpacklo_epi16(hi, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos + 12), _mm_unpackhi_epi16(hi, zero));
+        pos += 16;
+    }
+
+    return pos;
+}
+
+size_t narrowASCII(const char16_t* src, size_t len, char* dst) {
+    const __m128i nonASCII = _mm_set1_epi16((int16_t)0xFF80);
+    size_t pos = 0;
+    while (pos + 16 <= len) {
+        const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos));
+        const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos + 8));
+        const __m128i high = _mm_and_si128(_mm_or_si128(lo, hi), nonASCII);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(high, _mm_setzero_si128())) != 0xFFFF) {
+            break;
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos), _mm_packus_epi16(lo, hi));
+        pos += 16;
+    }
+
+    return pos;
+}
+
+size_t narrowASCII(const char32_t* src, size_t len, char* dst) {
+    const __m128i nonASCII = _mm_set1_epi32((int32_t)0xFFFFFF80);
+    size_t pos = 0;
+    while (pos + 16 <= len) {
+        __m128i in[4];
+        __m128i all = _mm_setzero_si128();
+        for (size_t i = 0; i < 4; i++) {
+            in[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos + i * 4));
+            all = _mm_or_si128(all, in[i]);
+        }
+
+        const __m128i high = _mm_and_si128(all, nonASCII);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(high, _mm_setzero_si128())) != 0xFFFF) {
+            break;
+        }
+
+        // Values below 0x80 survive both signed saturations
+        const __m128i lo = _mm_packs_epi32(in[0], in[1]);
+        const __m128i hi = _mm_packs_epi32(in[2], in[3]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos), _mm_packus_epi16(lo, hi));
+        pos += 16;
+    }
+
+    return pos;
+}
+
+#else
+
+template <typename CharType>
+size_t widenASCII(const char*, size_t, CharType*) {
+    return 0;
+}
+
+template <typename CharType>
+size_t narrowASCII(const CharType*, size_t, char*) {
+    return 0;
+}
+
+#endif
+
+constexpr Kernels SCALAR_KERNELS {"scalar", validateScalar, countScalar, offsetScalar};
+
+Kernels selectKernels() {
+#if defined(__x86_64__)
+    const Kernels available[] = {
+        {"avx2", validateAVX2, countAVX2, offsetAVX2},
+        {"ssse3", validateSSSE3, countSSE2, offsetSSE2},
+    };
+
+    const bool supported[] = {
+        __builtin_cpu_supports("avx2")
+            && __builtin_cpu_supports("bmi")
+            && __builtin_cpu_supports("bmi2")
+            && __builtin_cpu_supports("popcnt"),
+        (bool)__builtin_cpu_supports("ssse3"),
+    };
+
+    // Kernels at most as wide as the requested ones
+    const char* requested = getenv("TURING_UTF8_ISA");
+    bool allowed = !requested;
+
+    for (size_t i = 0; i < std::size(available); i++) {
+        allowed = allowed || std::string_view(requested) == available[i].name;
+        if (allowed && supported[i]) {
+            return available[i];
+        }
+    }
+#endif
+
+    return SCALAR_KERNELS;
+}
+
+const Kernels& getKernels() {
+    static const Kernels kernels = selectKernels();
+    return kernels;
+}
+
+}
+
+bool UTF8Utils::validate(std::string_view str) {
+    return getKernels().validate(str.data(), str.size());
+}
+
+size_t UTF8Utils::countCodePoints(std::string_view str) {
+    return getKernels().count(str.data(), str.size());
+}
+
+size_t UTF8Utils::getCodePointOffset(std::string_view str, size_t index) {
+    return getKernels().offset(str.data(), str.size(), index);
+}
+
+bool UTF8Utils::toUTF16(std::string_view src, std::u16string& dst) {
+    dst.clear();
+    if (!validate(src)) {
+        return false;
+    }
+
+    // A UTF-8 string never has fewer bytes than UTF-16 code units
+    dst.resize(src.size());
+
+    const uint8_t* s = reinterpret_cast<const uint8_t*>(src.data());
+    const size_t len = src.size();
+    char16_t* out = dst.data();
+    size_t pos = 0;
+
+    while (pos < len) {
+        const size_t ascii = widenASCII(src.data() + pos, len - pos, out);
+        pos += ascii;
+        out += ascii;
+
+        while (pos < len) {
+            if (s[pos] < 0x80) {
+                *out++ = s[pos++];
+                if (pos + 16 <= len && s[pos] < 0x80) {
+                    break;
+                }
+                continue;
+            }
+
+            uint32_t codePoint = 0;
+            pos += decodeValid(s + pos, codePoint);
+            if (codePoint < 0x10000) {
+                *out++ = codePoint;
+            } else {
+                codePoint -= 0x10000;
+                *out++ = 0xD800 + (codePoint >> 10);
+                *out++ = 0xDC00 + (codePoint & 0x3FF);
+            }
+        }
+    }
+
+    dst.resize(out - dst.data());
+    return true;
+}
+
+bool UTF8Utils::toUTF32(std::string_view src, std::u32string& dst) {
+    dst.clear();
+    if (!validate(src)) {
+        return false;
+    }
+
+    dst.resize(src.size());
+
+    const uint8_t* s = reinterpret_cast<const uint8_t*>(src.data());
+    const size_t len = src.size();
+    char32_t* out = dst.data();
+    size_t pos = 0;
+
+    while (pos < len) {
+        const size_t ascii = widenASCII(src.data() + pos, len - pos, out);
+        pos += ascii;
+        out += ascii;
+
+        while (pos < len) {
+            if (s[pos] < 0x80) {
+                *out++ = s[pos++];
+                if (pos + 16 <= len && s[pos] < 0x80) {
+                    break;
+                }
+                continue;
+            }
+
+            uint32_t codePoint = 0;
+            pos += decodeValid(s + pos, codePoint);
+            *out++ = codePoint;
+        }
+    }
+
+    dst.resize(out - dst.data());
+    return true;
+}
+
+bool UTF8Utils::fromUTF16(std::u16string_view src, std::string& dst) {
+    // At most 3 bytes per code unit, surrogate pairs take 4 bytes for 2
+    dst.resize(src.size() * 3);
+
+    const size_t len = src.size();
+    char* out = dst.data();
+    size_t pos = 0;
+
+    while (pos < len) {
+        const size_t ascii = narrowASCII(src.data() + pos, len - pos, out);
+        pos += ascii;
+        out += ascii;
+
+        while (pos < len) {
+            uint32_t codePoint = src[pos++];
+            if (codePoint < 0x80) {
+                *out++ = codePoint;
+                if (pos + 16 <= len && src[pos] < 0x80) {
+                    break;
+                }
+                continue;
+            }
+
+            if (codePoint >= 0xD800 && codePoint <= 0xDFFF) {
+                if (codePoint > 0xDBFF || pos == len
+                    || src[pos] < 0xDC00 || src[pos] > 0xDFFF) {
+                    dst.clear();
+                    return false;
+                }
+                codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (src[pos++] - 0xDC00);
+            }
+
+            out += encodeUTF8(codePoint, out);
+        }
+    }
+
+    dst.resize(out - dst.data());
+    return true;
+}
+
+bool UTF8Utils::fromUTF32(std::u32string_view src, std::string& dst) {
+    dst.resize(src.size() * 4);
+
+    const size_t len = src.size();
+    char* out = dst.data();
+    size_t pos = 0;
+
+    while (pos < len) {
+        const size_t ascii = narrowASCII(src.data() + pos, len - pos, out);
+        pos += ascii;
+        out += ascii;
+
+        while (pos < len) {
+            const uint32_t codePoint = src[pos++];
+            if (codePoint < 0x80) {
+                *out++ = codePoint;
+                if (pos + 16 <= len && src[pos] < 0x80) {
+                    break;
+                }
+                continue;
+            }
+
+            if (codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF)) {
+                dst.clear();
+                return false;
+            }
+
+            out += encodeUTF8(codePoint, out);
+        }
+    }
+
+    dst.resize(out - dst.data());
+    return true;
+}
+
+const char* UTF8Utils::getKernelName() {
+    return getKernels().name;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <string_view>
+
+// Validation, counting and transcoding of UTF-8 strings.
+//
+// Validation follows the lookup algorithm of J. Keiser and D. Lemire,
+// "Validating UTF-8 In Less Than One Instruction Per Byte": each byte is
+// checked against its predecessors with three nibble table lookups, 16 or
+// 32 bytes at a time, and blocks of ASCII only check the previous block did
+// not end in the middle of a character. Overlong forms, surrogates, code
+// points above U+10FFFF and truncated sequences are all rejected.
+//
+// The SSSE3 or AVX2 kernels are selected once at startup from the CPU
+// features, TURING_UTF8_ISA=scalar|ssse3|avx2 limits the selection.
+class UTF8Utils {
+public:
+    UTF8Utils() = delete;
+
+    static bool validate(std::string_view str);
+
+    // Number of code points of a valid UTF-8 string
+    static size_t countCodePoints(std::string_view str);
+
+    // Byte offset of the code point at index in a valid UTF-8 string,
+    // or str.size() if it has index code points or less
+    static size_t getCodePointOffset(std::string_view str, size_t index);
+
+    // Transcoders replace the content of dst. They return false if src is
+    // malformed, dst is then left empty
+    static bool toUTF16(std::string_view src, std::u16string& dst);
+    static bool toUTF32(std::string_view src, std::u32string& dst);
+    static bool fromUTF16(std::u16string_view src, std::string& dst);
+    static bool fromUTF32(std::u32string_view src, std::string& dst);
+
+    // Name of the kernels in use: "scalar", "ssse3" or "avx2"
+    static const char* getKernelName();
+};
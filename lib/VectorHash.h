@@ -1,54 +1,172 @@
 #pragma once
 
+#include <string.h>
+#include <algorithm>
+#include <concepts>
 #include <vector>
+#include <span>
 #include <functional>
 #include <type_traits>
 
+#include "HashUtils.h"
+#include "SmallVector.h"
+
+// Hash and equality of sequences of T, transparent over every container
+// holding the same elements: std::vector<T>, std::span<const T>, std::array,
+// C arrays and SmallVector hash and compare identically. Hash tables keyed by
+// std::vector<T> can then be probed with non-owning keys, e.g.
+// map.find(std::span<const T>(buffer, size)) with a transparent table.
 template <class T>
 struct VectorHash {
+    using is_transparent = void;
+    using Span = std::span<const T>;
+
+    // Types whose equality is the equality of their bytes (integers, enums,
+    // structs without padding) are hashed and compared as one block of memory
+    static constexpr bool BytewiseHashable = !std::is_pointer_v<T>
+                                          && std::has_unique_object_representations_v<T>;
+
     // Uses the hash of objects of type T if T is a class or POD
     // or uses the hash of the objects pointed by T if T is a pointer.
     // Use case: we support both std::vector<std::string> and std::vector<std::string*>
-    std::size_t operator()(const std::vector<T>& vec) const {
-        std::size_t value = vec.size();
-        for (const auto& data : vec) {
-            std::size_t x = 0;
-            if constexpr (std::is_pointer_v<T>) {
-                using DataType = typename std::remove_pointer<T>::type;
-                using DataTypeWithoutConst = typename std::remove_const<DataType>::type;
-                x = std::hash<DataTypeWithoutConst>{}(*data);
-            } else {
-                x = std::hash<T>{}(data);
+    std::size_t operator()(Span span) const {
+        if constexpr (BytewiseHashable) {
+            return HashUtils::hashBytes(span.data(), span.size_bytes());
+        } else {
+            std::size_t value = span.size();
+            for (const auto& data : span) {
+                value = HashUtils::hashCombine(value, hashElement(data));
             }
-            x = ((x >> 16) ^ x) * 0x45d9f3b;
-            x = ((x >> 16) ^ x) * 0x45d9f3b;
-            x = (x >> 16) ^ x;
-            value ^= x + 0x9e3779b9 + (value << 6) + (value >> 2);
+            return value;
+        }
+    }
+
+    // std::vector<bool> packs its elements in bits and converts to no span,
+    // they are unpacked to hash the same bytes as contiguous bools
+    std::size_t operator()(const std::vector<T>& vec) const requires std::same_as<T, bool> {
+        thread_local std::vector<char> buffer;
+        buffer.assign(vec.begin(), vec.end());
+        return HashUtils::hashBytes(buffer.data(), buffer.size());
+    }
+
+    // SmallVector derives from std::vector but does not store its elements
+    // there, so it must never be converted to a std::vector reference
+    template <size_t N>
+    std::size_t operator()(const SmallVector<T, N>& vec) const {
+        const size_t size = vec.size();
+
+        if constexpr (BytewiseHashable) {
+            if (size <= N) {
+                [[likely]]
+                return (*this)(Span(&vec[0], size));
+            }
+
+            // The elements are split between the inline array and the heap
+            // storage, gather them to hash the same bytes as a contiguous key
+            thread_local std::vector<T> buffer;
+            buffer.resize(size);
+            memcpy(buffer.data(), &vec[0], N * sizeof(T));
+            memcpy(buffer.data() + N, &vec[N], (size - N) * sizeof(T));
+            return (*this)(Span(buffer));
+        } else {
+            std::size_t value = size;
+            for (size_t i = 0; i < size; i++) {
+                value = HashUtils::hashCombine(value, hashElement(vec[i]));
+            }
+            return value;
         }
-        return value;
     }
 
     struct Equal {
-        bool operator()(const std::vector<T>& lhs,
-                        const std::vector<T>& rhs) const {
+        using is_transparent = void;
+
+        bool operator()(Span lhs, Span rhs) const {
             if (lhs.size() != rhs.size()) {
                 return false;
             }
 
-            const std::size_t size = lhs.size();
+            return equalElements(lhs.data(), rhs.data(), lhs.size());
+        }
+
+        bool operator()(const std::vector<T>& lhs,
+                        const std::vector<T>& rhs) const requires std::same_as<T, bool> {
+            return lhs == rhs;
+        }
+
+        bool operator()(const std::vector<T>& lhs, Span rhs) const requires std::same_as<T, bool> {
+            return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+        }
+
+        bool operator()(Span lhs, const std::vector<T>& rhs) const requires std::same_as<T, bool> {
+            return (*this)(rhs, lhs);
+        }
+
+        template <size_t N>
+        bool operator()(const SmallVector<T, N>& lhs, Span rhs) const {
+            const size_t size = lhs.size();
+            if (size != rhs.size()) {
+                return false;
+            }
+
+            const size_t head = std::min(size, N);
+            if (!equalElements(&lhs[0], rhs.data(), head)) {
+                return false;
+            }
+
+            return size <= N || equalElements(&lhs[N], rhs.data() + N, size - N);
+        }
+
+        template <size_t N>
+        bool operator()(Span lhs, const SmallVector<T, N>& rhs) const {
+            return (*this)(rhs, lhs);
+        }
+
+        template <size_t N, size_t M>
+        bool operator()(const SmallVector<T, N>& lhs, const SmallVector<T, M>& rhs) const {
+            const size_t size = lhs.size();
+            if (size != rhs.size()) {
+                return false;
+            }
+
             for (size_t i = 0; i < size; i++) {
-                if constexpr (std::is_pointer_v<T>) {
-                    if (*lhs[i] != *rhs[i]) {
-                        return false;
-                    }
-                } else {
-                    if (lhs[i] != rhs[i]) {
-                        return false;
-                    }
+                if (!equalElements(&lhs[i], &rhs[i], 1)) {
+                    return false;
                 }
             }
 
             return true;
         }
+
+    private:
+        static bool equalElements(const T* lhs, const T* rhs, size_t count) {
+            if constexpr (BytewiseHashable) {
+                return count == 0 || memcmp(lhs, rhs, count * sizeof(T)) == 0;
+            } else {
+                for (size_t i = 0; i < count; i++) {
+                    if constexpr (std::is_pointer_v<T>) {
+                        if (*lhs[i] != *rhs[i]) {
+                            return false;
+                        }
+                    } else {
+                        if (lhs[i] != rhs[i]) {
+                            return false;
+                        }
+                    }
+                }
+
+                return true;
+            }
+        }
     };
+
+private:
+    static std::size_t hashElement(const T& data) {
+        if constexpr (std::is_pointer_v<T>) {
+            using DataType = typename std::remove_pointer<T>::type;
+            using DataTypeWithoutConst = typename std::remove_const<DataType>::type;
+            return std::hash<DataTypeWithoutConst>{}(*data);
+        } else {
+            return std::hash<T>{}(data);
+        }
+    }
 };
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "BioAssert.h"
+#include "FlatHashMap.h"
+#include "SmallVector.h"
+#include "VectorHash.h"
+
+// Hash-consing of sequences of T. Each distinct sequence is stored once,
+// contiguously in chunks of CHUNK_SIZE elements that never move, and is
+// identified by a dense 32-bit id in insertion order. Two sequences are
+// equal if and only if their ids are equal.
+// The index hashes sequences with VectorHash<T>, so it can be probed with
+// any container VectorHash accepts without copying it.
+template <typename T, size_t CHUNK_SIZE = 4096>
+class VectorInterner {
+public:
+    using ID = uint32_t;
+    using Span = std::span<const T>;
+
+    VectorInterner() = default;
+    ~VectorInterner() = default;
+
+    VectorInterner(const VectorInterner&) = delete;
+    VectorInterner(VectorInterner&&) noexcept = default;
+    VectorInterner& operator=(const VectorInterner&) = delete;
+    VectorInterner& operator=(VectorInterner&&) noexcept = default;
+
+    // Returns the id of seq, storing it if it was not interned yet
+    ID intern(Span seq) {
+        return internImpl(seq);
+    }
+
+    template <size_t N>
+    ID intern(const SmallVector<T, N>& seq) {
+        return internImpl(seq);
+    }
+
+    std::optional<ID> find(Span seq) const {
+        return findImpl(seq);
+    }
+
+    template <size_t N>
+    std::optional<ID> find(const SmallVector<T, N>& seq) const {
+        return findImpl(seq);
+    }
+
+    Span get(ID id) const { return _spans[id]; }
+    Span operator[](ID id) const { return _spans[id]; }
+
+    // Number of distinct sequences, ids are in [0, size())
+    size_t size() const { return _spans.size(); }
+    bool empty() const { return _spans.empty(); }
+
+    // Number of elements stored in the arena
+    size_t elementCount() const { return _elementCount; }
+
+    void reserve(size_t count) {
+        _spans.reserve(count);
+        _index.reserve(count);
+    }
+
+private:
+    struct Entry {
+        Span seq;
+        size_t hash {0};
+        ID id {0};
+    };
+
+    // Entries keep their hash so that growing the index does not hash
+    // the sequences again
+    struct EntryHash {
+        using is_transparent = void;
+
+        size_t operator()(const Entry& entry) const { return entry.hash; }
+
+        template <typename Seq>
+        size_t operator()(const Seq& seq) const { return VectorHash<T> {}(seq); }
+    };
+
+    struct EntryEqual {
+        using is_transparent = void;
+
+        bool operator()(const Entry& lhs, const Entry& rhs) const {
+            return lhs.id == rhs.id;
+        }
+
+        template <typename Seq>
+        bool operator()(const Entry& lhs, const Seq& rhs) const {
+            return typename VectorHash<T>::Equal {}(lhs.seq, rhs);
+        }
+    };
+
+    // Raw storage of the arena, only the first _used elements are
+    // constructed, so T needs no default constructor
+    class Chunk {
+    public:
+        explicit Chunk(size_t capacity)
+            : _data(std::allocator<T>().allocate(capacity)),
+            _capacity(capacity)
+        {
+        }
+
+        ~Chunk() {
+            if (_data) {
+                std::destroy_n(_data, _used);
+                std::allocator<T>().deallocate(_data, _capacity);
+            }
+        }
+
+        Chunk(const Chunk&) = delete;
+        Chunk& operator=(const Chunk&) = delete;
+        Chunk& operator=(Chunk&&) = delete;
+
+        Chunk(Chunk&& other) noexcept
+            : _data(std::exchange(other._data, nullptr)),
+            _capacity(other._capacity),
+            _used(other._used)
+        {
+        }
+
+        size_t left() const { return _capacity - _used; }
+
+        template <typename Seq>
+        T* append(const Seq& seq) {
+            T* dst = _data + _used;
+            std::uninitialized_copy(seq.begin(), seq.end(), dst);
+            _used += seq.size();
+            return dst;
+        }
+
+    private:
+        T* _data {nullptr};
+        size_t _capacity {0};
+        size_t _used {0};
+    };
+
+    std::vector<Chunk> _chunks;
+    size_t _elementCount {0};
+
+    std::vector<Span> _spans;
+    FlatHashSet<Entry, EntryHash, EntryEqual> _index;
+
+    template <typename Seq>
+    std::optional<ID> findImpl(const Seq& seq) const {
+        const auto it = _index.find(seq);
+        if (it == _index.end()) {
+            return std::nullopt;
+        }
+
+        return it->id;
+    }
+
+    template <typename Seq>
+    ID internImpl(const Seq& seq) {
+        const auto it = _index.find(seq);
+        if (it != _index.end()) {
+            return it->id;
+        }
+
+        bioassert(_spans.size() < std::numeric_limits<ID>::max(),
+                  "VectorInterner can not hold more than {} sequences",
+                  std::numeric_limits<ID>::max());
+
+        const ID id = _spans.size();
+        const Span stored = store(seq);
+        _spans.push_back(stored);
+        _index.insert(Entry {stored, EntryHash {}(seq), id});
+
+        return id;
+    }
+
+    template <typename Seq>
+    Span store(const Seq& seq) {
+        const size_t size = seq.size();
+        if (size == 0) {
+            return {};
+        }
+
+        if (_chunks.empty() || size > _chunks.back().left()) {
+            // Sequences longer than a chunk get a chunk of their own
+            _chunks.emplace_back(std::max(size, CHUNK_SIZE));
+        }
+
+        T* dst = _chunks.back().append(seq);
+        _elementCount += size;
+
+        return Span(dst, size);
+    }
+};